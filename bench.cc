@@ -0,0 +1,62 @@
+#include "bench.h"
+#include <chrono>
+#include "gauss.h"
+#include "genus.h"
+#include "moves.h"
+#include <random>
+#include <string>
+#include <vector>
+#include "virtual.h"
+
+// bigger than this and the R2 undo moves don't fit in memory
+static const size_t bench_r2_undo_max = 128;
+
+// microseconds f takes
+template <typename F>
+static double time_us(F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+void bench_scaling(size_t max_chords, uint64_t seed, std::ostream& out)
+{
+    std::mt19937_64 rng(seed);
+
+    // the first call sets up the genus cache, which shouldn't be counted
+    planar_knot(code_t());
+    out << "chords\tparse\tcanon\tplanar\tr1\tr2_do\tr2_undo\tr3\tneighbors" << std::endl;
+
+    for (size_t chords = 8; chords <= max_chords; chords *= 2) {
+        code_t raw(2 * chords), code(2 * chords);
+        random_raw_code(chords, rng, raw.data());
+        std::string s = stringify_code(raw);
+        size_t found = 0;
+
+        out << chords;
+        out << "\t" << time_us([&] { found += parse_code(s).size(); });
+        out << "\t" << time_us([&] { canonicalize_code(raw.data(), raw.size(), code.data()); });
+        out << "\t" << time_us([&] { found += planar_knot(code); });
+
+        code_list_t list;
+        out << "\t" << time_us([&] { found += r1_do_enumerate(code).size() + r1_undo_enumerate(code).size(); });
+        out << "\t" << time_us([&] { found += r2_do_enumerate(code).size(); });
+        if (chords <= bench_r2_undo_max) {
+            out << "\t" << time_us([&] { found += r2_undo_enumerate(code).size(); });
+        } else {
+            out << "\t-";
+        }
+        out << "\t" << time_us([&] { found += r3_enumerate(code).size(); });
+
+        // the neighbors a search goes through first
+        out << "\t" << time_us([&] { enumerate_special_neighbors(code.data(), code.size(), list); });
+        out << std::endl;
+
+        // so none of it can be left out
+        if (!found) {
+            out << "# nothing found" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,258 @@
+#include <algorithm>
+#include "census.h"
+#include "gauss.h"
+#include <vector>
+
+static const size_t none = -1;
+
+// key of the element at offset k of a rotation of the census' code which
+// begins at start, ordered the same way the element would be after
+// renumbering that rotation (see rotation_key in gauss.cc)
+static inline size_t census_key(const census_t& census, size_t start, size_t k)
+{
+    size_t length = 2 * census.chords, pos = start + k;
+    size_t q = census.partner[pos], flags = census.code[pos] & ELEM_FLAGS_MASK;
+    if (q != none && q >= start && q < pos) {
+        return ((q - start) << ELEM_ID_SHIFT) | flags;
+    } else {
+        return (length << ELEM_ID_SHIFT) | flags;
+    }
+}
+
+// take the last element off
+static void census_unplace(census_t& census)
+{
+    size_t pos = census.code.size() - 1;
+    for (size_t s = 1; s <= pos; s++) {
+        if (census.untied[s] == pos) {
+            census.untied[s] = none;
+        }
+    }
+
+    size_t q = census.partner[pos];
+    if (q != none) {
+        // it closed a chord
+        census.partner[q] = census.partner[pos] = none;
+        census.open++;
+    } else {
+        census.next_id--;
+        census.open--;
+    }
+
+    census.code.pop_back();
+}
+
+// try putting e next, returning false if it can't go there or would make
+// some rotation come first
+static bool census_place(census_t& census, code_elem_t e)
+{
+    size_t length = 2 * census.chords, pos = census.code.size();
+    code_elem_t id = ELEM_ID(e), flags = e & ELEM_FLAGS_MASK;
+    if (pos >= length || id > census.next_id) {
+        return false;
+    }
+
+    if (id == census.next_id) {
+        // opening a chord: needs to be one left, and room to close it and
+        // every other open one
+        if (census.next_id >= census.chords || length - pos - 1 < census.open + 1) {
+            return false;
+        }
+
+        census.opened[id] = pos;
+        census.next_id++;
+        census.open++;
+    } else {
+        size_t q = census.opened[id];
+        if (census.partner[q] != none) {
+            return false;
+        }
+
+        // the other end has to match up
+#ifdef FLAT_KNOTS
+        if (flags != ((census.code[q] & ELEM_FLAGS_MASK) ^ ELEM_SIGN_MASK)) {
+#else
+        if (flags != ((census.code[q] & ELEM_FLAGS_MASK) ^ ELEM_OU_MASK)) {
+#endif
+            return false;
+        }
+
+        census.partner[q] = pos; census.partner[pos] = q;
+        census.open--;
+    }
+
+    census.code.push_back(e);
+
+    // everything in a rotation starting inside the code so far is known
+    // up to here, so compare the newest element against the code itself
+    for (size_t s = 1; s <= pos; s++) {
+        if (census.untied[s] != none) {
+            continue;
+        }
+
+        size_t rotated = census_key(census, s, pos - s), own = census_key(census, 0, pos - s);
+        if (rotated < own) {
+            census_unplace(census);
+            return false;
+        } else if (rotated > own) {
+            census.untied[s] = pos;
+        }
+    }
+
+    return true;
+}
+
+// if the finished code comes before all of its rotations
+static bool census_first(const census_t& census)
+{
+    if (census.code.empty()) {
+        return true;
+    }
+
+    code_t first(census.code.size());
+    canonicalize_code(census.code.data(), census.code.size(), first.data());
+    return first == census.code;
+}
+
+// move on to the next code (or prefix, if depth is short of a full code)
+static bool census_advance(census_t& census, size_t depth)
+{
+    if (census.done) {
+        return false;
+    }
+
+    code_elem_t from = 0;
+    if (!census.started) {
+        census.started = true;
+        if (census.code.size() == depth) {
+            return (depth < 2 * census.chords) || census_first(census);
+        }
+    } else {
+        if (census.code.size() <= census.fixed) {
+            census.done = true;
+            return false;
+        }
+
+        from = census.code.back() + 1;
+        census_unplace(census);
+    }
+
+    while (true) {
+        // try every element which could go next, in order
+        code_elem_t last = (census.next_id << ELEM_ID_SHIFT) | ELEM_FLAGS_MASK, e;
+        bool placed = false;
+        for (e = from; e <= last; e++) {
+            if (census_place(census, e)) {
+                placed = true;
+                break;
+            }
+        }
+
+        if (placed) {
+            if (census.code.size() < depth) {
+                from = 0;
+                continue;
+            }
+
+            if (depth < 2 * census.chords || census_first(census)) {
+                return true;
+            }
+
+            from = e + 1;
+            census_unplace(census);
+            continue;
+        }
+
+        // nothing fits, so back up
+        if (census.code.size() <= census.fixed) {
+            census.done = true;
+            return false;
+        }
+
+        from = census.code.back() + 1;
+        census_unplace(census);
+    }
+}
+
+// start a census of codes with chords chords which begin with prefix
+void census_start(census_t& census, size_t chords, const code_t& prefix)
+{
+    census.chords = chords;
+    census.code.clear();
+    census.code.reserve(2 * chords);
+    census.opened.assign(chords, none);
+    census.partner.assign(2 * chords, none);
+    census.untied.assign(2 * chords, none);
+    census.next_id = 0;
+    census.open = 0;
+    census.started = census.done = false;
+
+    for (auto e: prefix) {
+        if (!census_place(census, e)) {
+            census.done = true;
+            break;
+        }
+    }
+
+    census.fixed = census.code.size();
+}
+
+// start a census which picks up after last, a code given out by a census
+// with the same chords and prefix
+void census_resume(census_t& census, size_t chords, const code_t& prefix, const code_t& last)
+{
+    census_start(census, chords, prefix);
+    if (census.done || last.size() != 2 * chords ||
+        !std::equal(prefix.begin(), prefix.end(), last.begin())) {
+        census.done = true;
+        return;
+    }
+
+    for (size_t i = prefix.size(); i < last.size(); i++) {
+        if (!census_place(census, last[i])) {
+            census.done = true;
+            return;
+        }
+    }
+
+    census.started = true;
+}
+
+// the next code in the census, or false once it's done
+bool census_next(census_t& census, code_t& out)
+{
+    if (!census_advance(census, 2 * census.chords)) {
+        return false;
+    }
+
+    out = census.code;
+    return true;
+}
+
+// every prefix of length depth which some first ordered code with chords
+// chords starts with, in order, for handing out to separate workers
+// (some of them may turn out to have no codes after all)
+std::vector<code_t> census_prefixes(size_t chords, size_t depth)
+{
+    std::vector<code_t> prefixes;
+    census_t census; census_start(census, chords);
+
+    depth = std::min(depth, 2 * chords);
+    while (census_advance(census, depth)) {
+        prefixes.push_back(census.code);
+    }
+
+    return prefixes;
+}
+
+// every first ordered code with up to max_chords chords
+void census_all(size_t max_chords, const std::function<void(const code_t&)>& callback)
+{
+    for (size_t chords = 0; chords <= max_chords; chords++) {
+        census_t census; census_start(census, chords);
+        code_t code;
+        while (census_next(census, code)) {
+            callback(code);
+        }
+    }
+}
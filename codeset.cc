@@ -0,0 +1,196 @@
+#include <algorithm>
+#include "codeset.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include "gauss.h"
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#ifdef FLAT_KNOTS
+static const uint32_t codeset_flavor = CODESET_FLAT;
+#else
+static const uint32_t codeset_flavor = CODESET_CLASSICAL;
+#endif
+
+// words needed to hold a code of this many chords
+static uint32_t record_words(uint32_t chords)
+{
+    size_t length = 2 * chords;
+    return std::max((size_t) 1, (length + PACKED_WORD_ELEMS - 1) / PACKED_WORD_ELEMS);
+}
+
+// writes the codes (which must be canonical) out sorted and without
+// duplicates
+// returns false if the file couldn't be written
+bool write_codeset(const std::string& path, std::vector<packed_code_t> codes)
+{
+    std::sort(codes.begin(), codes.end());
+    codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+
+    codeset_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CODESET_MAGIC;
+    header.version = CODESET_VERSION;
+    header.flavor = codeset_flavor;
+    for (auto& iter: codes) {
+        header.chords = std::max(header.chords, (uint32_t) (packed_length(iter) / 2));
+    }
+    header.record_words = record_words(header.chords);
+    header.count = codes.size();
+    header.index_count = (codes.size() + CODESET_STRIDE - 1) / CODESET_STRIDE;
+    header.index_offset = sizeof(header);
+    header.records_offset = header.index_offset + header.index_count * header.record_words * sizeof(uint64_t);
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (size_t i = 0; ok && i < codes.size(); i += CODESET_STRIDE) {
+        ok = fwrite(codes[i].words, sizeof(uint64_t), header.record_words, f) == header.record_words;
+    }
+    for (size_t i = 0; ok && i < codes.size(); i++) {
+        ok = fwrite(codes[i].words, sizeof(uint64_t), header.record_words, f) == header.record_words;
+    }
+
+    ok = !fclose(f) && ok;
+    return ok;
+}
+
+// maps a file written by write_codeset
+// returns false if it can't be read, or is for the other flavor of knots
+bool open_codeset(const std::string& path, codeset_t& set)
+{
+    memset(&set, 0, sizeof(set));
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(codeset_header_t)) {
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    // the index and records have to be laid out exactly as write_codeset
+    // does, as searching trusts them; every size is checked against what's
+    // left of the file before it's multiplied, so nothing can overflow
+    const codeset_header_t* header = (const codeset_header_t*) map;
+    uint64_t size = st.st_size, record_bytes = header->record_words * sizeof(uint64_t);
+    uint64_t index_count = header->count / CODESET_STRIDE + (header->count % CODESET_STRIDE != 0);
+    if (header->magic != CODESET_MAGIC || header->version != CODESET_VERSION ||
+        header->flavor != codeset_flavor || header->chords > PACKED_MAX_CHORDS ||
+        header->record_words != record_words(header->chords) ||
+        header->index_offset != sizeof(codeset_header_t) || header->index_count != index_count ||
+        header->index_count > (size - header->index_offset) / record_bytes ||
+        header->records_offset != header->index_offset + header->index_count * record_bytes ||
+        header->count > (size - header->records_offset) / record_bytes ||
+        header->records_offset + header->count * record_bytes != size) {
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    set.map = map; set.size = st.st_size; set.header = header;
+    set.index = (const uint64_t*) ((const char*) map + header->index_offset);
+    set.records = (const uint64_t*) ((const char*) map + header->records_offset);
+    return true;
+}
+
+void close_codeset(codeset_t& set)
+{
+    if (set.map) {
+        munmap(set.map, set.size);
+    }
+
+    memset(&set, 0, sizeof(set));
+}
+
+size_t codeset_size(const codeset_t& set)
+{
+    return set.header ? set.header->count : 0;
+}
+
+// unpack a record back into a full packed code
+static packed_code_t record_code(const codeset_t& set, const uint64_t* record)
+{
+    packed_code_t code = {};
+    memcpy(code.words, record, set.header->record_words * sizeof(uint64_t));
+    return code;
+}
+
+packed_code_t codeset_get(const codeset_t& set, size_t i)
+{
+    return record_code(set, set.records + i * set.header->record_words);
+}
+
+// compare a record with the first words of a code
+static int compare_record(const uint64_t* record, const packed_code_t& code, uint32_t words)
+{
+    for (uint32_t i = 0; i < words; i++) {
+        if (record[i] < code.words[i]) return -1;
+        else if (record[i] > code.words[i]) return 1;
+    }
+
+    return 0;
+}
+
+// where the (canonical) code is in the set, or CODESET_NONE
+size_t codeset_find(const codeset_t& set, const packed_code_t& code)
+{
+    if (!codeset_size(set)) {
+        return CODESET_NONE;
+    }
+
+    // too big to be in here
+    uint32_t words = set.header->record_words;
+    if (packed_length(code) / 2 > set.header->chords) {
+        return CODESET_NONE;
+    }
+
+    // find the last index entry not after code
+    size_t lo = 0, hi = set.header->index_count;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (compare_record(set.index + mid * words, code, words) <= 0) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // then search within its stride of records
+    size_t first = lo * CODESET_STRIDE;
+    size_t last = std::min((size_t) set.header->count, first + CODESET_STRIDE);
+    while (first < last) {
+        size_t mid = (first + last) / 2;
+        int cmp = compare_record(set.records + mid * words, code, words);
+        if (!cmp) {
+            return mid;
+        } else if (cmp < 0) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+
+    return CODESET_NONE;
+}
+
+// if the (canonical) code is in the set
+bool codeset_contains(const codeset_t& set, const packed_code_t& code)
+{
+    return codeset_find(set, code) != CODESET_NONE;
+}
@@ -1,59 +1,84 @@
 #include <algorithm>
+#include <cassert>
 #include <cctype>
 #include "gauss.h"
 #include <iostream>
 #include <map>
+#include <random>
 #include <string>
+#include <vector>
 
-// parse the string and return the code
-// returns empty code on error
-code_t parse_code(const std::string& s)
+// scan the elements of a code out of [begin, end) into out, which needs
+// room for (end - begin) / 2 elements, without renumbering them
+// returns NULL on success, or where the first bad character is
+const char* scan_code(const char* begin, const char* end, code_elem_t* out, size_t* length)
 {
-    code_t code; size_t length = s.length(); size_t max = 0;
-    for (int i = 0; i < length; ) {
+    const char* i = begin; *length = 0;
+    while (i < end) {
         // can skip whitespace between elements
-        if (std::isspace(s[i])) {
+        if (std::isspace(*i)) {
             i++; continue;
         }
 
         code_elem_t e = 0;
 #ifndef FLAT_KNOTS
-        if (s[i] == 'O') {
+        if (*i == 'O') {
             e |= ELEM_OVER;
-        } else if (s[i] != 'U') {
-            return code_t();
+        } else if (*i != 'U') {
+            return i;
         }
-        if (++i >= length) return code_t();
+        if (++i >= end) return i;
 
         char positive = '+', negative = '-';
 #else
         char positive = 'R', negative = 'L';
 #endif  
 
-        if (s[i] == positive) {
+        if (*i == positive) {
             e |= ELEM_POSITIVE;
-        } else if (s[i] != negative) {
-            return code_t();
+        } else if (*i != negative) {
+            return i;
         }
 
-        if (++i >= length) return code_t();
-        if (!std::isdigit(s[i])) return code_t();
+        if (++i >= end) return i;
+        if (!std::isdigit(*i)) return i;
 
         code_elem_t id = 0;
-        while (std::isdigit(s[i])) {
-            id = (id * 10) + (s[i++] - '0');
+        while (i < end && std::isdigit(*i)) {
+            id = (id * 10) + (*i++ - '0');
+            if (id > SCAN_MAX_ID) return i - 1;
         }
 
-        max = std::max(max, (size_t) id);
-        // todo: someday check for overflow, maybe
         e |= (id << ELEM_ID_SHIFT);
-        code.push_back(e);
+        out[(*length)++] = e;
+    }
+
+    return NULL;
+}
+
+// parse the string and return the code
+// returns empty code on error
+code_t parse_code(const std::string& s)
+{
+    code_t code(s.length() / 2); size_t length, max = 0;
+    if (scan_code(s.data(), s.data() + s.length(), code.data(), &length)) {
+        return code_t();
+    }
+
+    code.resize(length);
+    for (auto iter: code) {
+        max = std::max(max, (size_t) ELEM_ID(iter));
     }
 
     renumber_code(code, std::max(max + 1, code.size() / 2 + 1));
     return first_ordered_code(code);
 }
 
+packed_code_t parse_packed_code(const std::string& s)
+{
+    return pack_code(parse_code(s));
+}
+
 std::string stringify_code(const code_t& code)
 {
     if (!code.size()) {
@@ -74,24 +99,134 @@ std::string stringify_code(const code_t& code)
     return s;
 }
 
+std::string stringify_code(const packed_code_t& code)
+{
+    return stringify_code(unpack_code(code));
+}
+
 void display_code(const code_t& code)
 {
     std::cout << stringify_code(code) << std::endl;
 }
 
+void display_code(const packed_code_t& code)
+{
+    display_code(unpack_code(code));
+}
+
+void code_list_clear(code_list_t& list)
+{
+    list.offsets.resize(1);
+    list.elems.clear();
+}
+
+void code_list_push(code_list_t& list, const code_elem_t* code, size_t length)
+{
+    list.elems.insert(list.elems.end(), code, code + length);
+    list.offsets.push_back(list.elems.size());
+}
+
+code_t code_list_get(const code_list_t& list, size_t i)
+{
+    const code_elem_t* elems = code_list_elems(list, i);
+    return code_t(elems, elems + code_list_length(list, i));
+}
+
+std::vector<code_t> code_list_codes(const code_list_t& list)
+{
+    std::vector<code_t> codes; size_t size = code_list_size(list);
+    codes.reserve(size);
+    for (size_t i = 0; i < size; i++) {
+        codes.push_back(code_list_get(list, i));
+    }
+
+    return codes;
+}
+
+// packs a renumbered code of at most PACKED_MAX_CHORDS chords (see
+// packed_fits)
+packed_code_t pack_code(const code_elem_t* code, size_t length)
+{
+    assert(length <= 2 * PACKED_MAX_CHORDS && !(length % 2));
+
+    packed_code_t packed = {};
+    packed.words[0] = (uint64_t) (length / 2) << PACKED_CHORDS_SHIFT;
+    for (size_t i = 0; i < length; i++) {
+        assert(code[i] <= PACKED_ELEM_MASK);
+
+        size_t shift = PACKED_ELEM_BITS * (PACKED_WORD_ELEMS - 1 - i % PACKED_WORD_ELEMS);
+        packed.words[i / PACKED_WORD_ELEMS] |= (uint64_t) code[i] << shift;
+    }
+
+    return packed;
+}
+
+packed_code_t pack_code(const code_t& code)
+{
+    return pack_code(code.data(), code.size());
+}
+
+code_t unpack_code(const packed_code_t& code)
+{
+    size_t length = packed_length(code);
+    code_t unpacked(length);
+    for (size_t i = 0; i < length; i++) {
+        unpacked[i] = packed_elem(code, i);
+    }
+
+    return unpacked;
+}
+
+// unpack into a buffer with room for the largest packed code
+static size_t unpack_code(const packed_code_t& code, code_elem_t* out)
+{
+    size_t length = packed_length(code);
+    for (size_t i = 0; i < length; i++) {
+        out[i] = packed_elem(code, i);
+    }
+
+    return length;
+}
+
+// maps the ids of code onto 0 up to the number of distinct ids, keeping
+// their order and the flags, so anything indexed by id can be the size of
+// the code rather than of the largest id (parsed ones go up to SCAN_MAX_ID)
+static void compact_ids(code_elem_t* code, size_t length)
+{
+    static thread_local std::vector<code_elem_t> ids;
+    ids.resize(length);
+    for (size_t i = 0; i < length; i++) {
+        ids[i] = ELEM_ID(code[i]);
+    }
+
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    for (size_t i = 0; i < length; i++) {
+        code_elem_t id = std::lower_bound(ids.begin(), ids.end(), ELEM_ID(code[i])) - ids.begin();
+        code[i] = (id << ELEM_ID_SHIFT) | (code[i] & ELEM_FLAGS_MASK);
+    }
+}
+
 void renumber_code(code_t &code, code_elem_t max_id)
 {
-    code_elem_t renum[max_id];
-    for (size_t i = 0; i < max_id; i++) renum[i] = -1;
+    static const code_elem_t unseen = (code_elem_t) -1;
+    static thread_local std::vector<code_elem_t> renum;
 
     size_t length = code.size();
+    if (max_id > length) {
+        compact_ids(code.data(), length);
+        max_id = length;
+    }
+    renum.assign(max_id, unseen);
+
     code_elem_t cur_max = 0;
     
     for (size_t i = 0; i < length; i++) {
         code_elem_t id = ELEM_ID(code[i]);
         code_elem_t flags = code[i] & ELEM_FLAGS_MASK;
 
-        if (renum[id] != -1) {
+        if (renum[id] != unseen) {
             code[i] = (renum[id] << ELEM_ID_SHIFT) | flags;
         } else {
             code[i] = (cur_max << ELEM_ID_SHIFT) | flags;
@@ -100,8 +235,30 @@ void renumber_code(code_t &code, code_elem_t max_id)
     }
 }
 
+void renumber_code(packed_code_t &code)
+{
+    const size_t max_id = (PACKED_ELEM_MASK >> ELEM_ID_SHIFT) + 1;
+    static const code_elem_t unseen = (code_elem_t) -1;
+    code_elem_t elems[2 * PACKED_MAX_CHORDS], renum[max_id];
+    size_t length = unpack_code(code, elems);
+    for (size_t i = 0; i < max_id; i++) renum[i] = unseen;
+
+    code_elem_t cur_max = 0;
+    for (size_t i = 0; i < length; i++) {
+        code_elem_t id = ELEM_ID(elems[i]);
+        code_elem_t flags = elems[i] & ELEM_FLAGS_MASK;
+
+        if (renum[id] == unseen) {
+            renum[id] = cur_max++;
+        }
+        elems[i] = (renum[id] << ELEM_ID_SHIFT) | flags;
+    }
+
+    code = pack_code(elems, length);
+}
+
 // takes in renumbered code
-code_t rotate_code(code_t code, size_t num)
+static code_t rotate_code(code_t code, size_t num)
 {
     // todo: can do this in one pass, measure impact later if it matters
     num %= code.size();
@@ -112,6 +269,19 @@ code_t rotate_code(code_t code, size_t num)
     return code;
 }
 
+// rotate the code left by num and renumber it
+packed_code_t rotate_code(const packed_code_t& code, size_t num)
+{
+    code_elem_t elems[2 * PACKED_MAX_CHORDS];
+    size_t length = unpack_code(code, elems);
+    if (!length) return code;
+
+    std::rotate(elems, elems + (num % length), elems + length);
+    packed_code_t rotated = pack_code(elems, length);
+    renumber_code(rotated);
+    return rotated;
+}
+
 // negative if a < b, positive if a > b, 0 if equal
 int compare_codes(const code_t& a, const code_t& b)
 {
@@ -127,8 +297,23 @@ int compare_codes(const code_t& a, const code_t& b)
     return 0;
 }
 
-// pick the first of them based on the ordering from compare_codes
-code_t first_ordered_code(code_t code)
+// negative if a < b, positive if a > b, 0 if equal
+int compare_codes(const packed_code_t& a, const packed_code_t& b)
+{
+    for (int i = 0; i < PACKED_WORDS; i++) {
+        if (a.words[i] < b.words[i]) return -1;
+        else if (a.words[i] > b.words[i]) return 1;
+    }
+
+    // equal
+    return 0;
+}
+
+// pick the first of them based on the ordering from compare_codes, by
+// trying every rotation
+// only used for codes which aren't chord diagrams (ids not appearing exactly
+// twice), where the relabelling in least_rotation doesn't hold
+static code_t first_ordered_code_quadratic(code_t code)
 {
     code_t& first = code, prev = code, cur = code;
     for (int i = 1; i < code.size(); i++) {
@@ -142,22 +327,443 @@ code_t first_ordered_code(code_t code)
     return first;
 }
 
-code_t random_code(size_t max_length)
+// scratch space for canonicalization, reused across calls
+static thread_local std::vector<size_t> scratch_dist, scratch_cand;
+
+// fill in scratch_dist with, for every position, how far back (cyclically)
+// the other end of its chord is
+// returns false if some id doesn't appear exactly twice
+static bool chord_distances(const code_elem_t* code, size_t length)
 {
-    // get a random code of max_length
-    code_t c;
-    for (size_t i = 0; i < max_length; i++) {
+    code_elem_t max_id = 0;
+    for (size_t i = 0; i < length; i++) {
+        max_id = std::max(max_id, (code_elem_t) ELEM_ID(code[i]));
+    }
+
+    // sparse ids get compacted first, so seen stays the size of the code
+    static thread_local code_t compacted;
+    if (max_id >= length) {
+        compacted.assign(code, code + length);
+        compact_ids(compacted.data(), length);
+        code = compacted.data();
+    }
+
+    // first seen position of each id, reusing the candidate space
+    std::vector<size_t>& seen = scratch_cand;
+    seen.assign(length, length);
+    scratch_dist.assign(length, 0);
+
+    for (size_t i = 0; i < length; i++) {
+        code_elem_t id = ELEM_ID(code[i]);
+        if (seen[id] == length) {
+            seen[id] = i;
+        } else if (seen[id] < length) {
+            // second time, link both ends up
+            scratch_dist[i] = i - seen[id];
+            scratch_dist[seen[id]] = length - scratch_dist[i];
+            seen[id] = length + 1;
+        } else {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        if (!scratch_dist[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// key of the element at pos (which can run past the end, going around
+// again) k elements into a rotation, ordered the same way the element would
+// be after renumbering that rotation
+// a chord closing at k gets the id handed out at its opening, and ids are
+// handed out in order, so it sorts by where it opened; a chord opening at k
+// gets a brand new id, larger than all before it
+// the key only depends on k and the element, not where the rotation began,
+// so prefixes of rotations can be matched against each other like strings
+static inline size_t rotation_key(const code_elem_t* code, size_t length, size_t pos, size_t k)
+{
+    while (pos >= length) pos -= length;
+    size_t d = scratch_dist[pos], flags = code[pos] & ELEM_FLAGS_MASK;
+    if (d <= k) {
+        return ((k - d) << ELEM_ID_SHIFT) | flags;
+    } else {
+        return (SIZE_MAX >> 1 & ~ELEM_FLAGS_MASK) | flags;
+    }
+}
+
+// Booth's algorithm over the keys, going along the code twice with a
+// failure function over the prefix of the best rotation so far; the key of
+// the element being looked at is worked out again whenever it's matched at
+// a different offset, so it's linear even for codes which are nearly
+// periodic
+static size_t booth_least_rotation(const code_elem_t* code, size_t length)
+{
+    static const size_t none = -1;
+    // the candidates are done with by now, and every entry is written
+    // before it's read, except the first
+    std::vector<size_t>& fail = scratch_cand;
+    fail.resize(2 * length);
+    fail[0] = none;
+
+    size_t best = 0;
+    for (size_t j = 1; j < 2 * length; j++) {
+        // i + 1 elements of the best rotation matched so far, ending just
+        // before j
+        size_t i = fail[j - best - 1];
+        while (i != none) {
+            size_t key = rotation_key(code, length, j, i + 1);
+            size_t want = rotation_key(code, length, best + i + 1, i + 1);
+            if (key == want) {
+                break;
+            }
+            if (key < want) {
+                best = j - i - 1;
+            }
+            i = fail[i];
+        }
+
+        if (i == none) {
+            size_t key = rotation_key(code, length, j, 0), want = rotation_key(code, length, best, 0);
+            if (key != want) {
+                if (key < want) {
+                    best = j;
+                }
+                fail[j - best] = none;
+                continue;
+            }
+        }
+
+        fail[j - best] = i + 1;
+    }
+
+    return best;
+}
+
+// find the rotation which is first after renumbering, without building
+// any of them
+// all rotations start out as candidates, and at every step only the ones
+// with the least renumbered element survive, which for most codes leaves
+// one after a few steps; nearly periodic codes keep lots of them going for
+// a long way though, so once that's taken as long as going around twice
+// it's left to Booth's algorithm
+static size_t least_rotation(const code_elem_t* code, size_t length)
+{
+    std::vector<size_t>& cand = scratch_cand;
+    cand.resize(length);
+    for (size_t i = 0; i < length; i++) {
+        cand[i] = i;
+    }
+
+    size_t count = length, budget = 2 * length;
+    for (size_t k = 0; k < length && count > 1; k++) {
+        if (count > budget) {
+            return booth_least_rotation(code, length);
+        }
+        budget -= count;
+
+        size_t least = rotation_key(code, length, cand[0] + k, k);
+        size_t kept = 1;
+        for (size_t i = 1; i < count; i++) {
+            size_t key = rotation_key(code, length, cand[i] + k, k);
+            if (key < least) {
+                least = key;
+                cand[0] = cand[i]; kept = 1;
+            } else if (key == least) {
+                cand[kept++] = cand[i];
+            }
+        }
+
+        count = kept;
+    }
+
+    return cand[0];
+}
+
+// write out the rotation beginning at start, renumbered
+static void rotate_renumber(const code_elem_t* code, size_t length,
+                            size_t start, code_elem_t* out)
+{
+    code_elem_t cur_max = 0;
+    for (size_t k = 0; k < length; k++) {
+        size_t pos = start + k; if (pos >= length) pos -= length;
+        size_t d = scratch_dist[pos];
+        code_elem_t flags = code[pos] & ELEM_FLAGS_MASK;
+
+        if (d <= k) {
+            out[k] = (out[k - d] & ELEM_ID_MASK) | flags;
+        } else {
+            out[k] = (cur_max++ << ELEM_ID_SHIFT) | flags;
+        }
+    }
+}
+
+// writes the first ordered rotation of code (which doesn't need to be
+// renumbered) into out, which can't overlap code
+// returns false if code isn't a chord diagram, leaving out untouched
+bool canonicalize_code(const code_elem_t* code, size_t length, code_elem_t* out)
+{
+    if (!length) {
+        return true;
+    }
+
+    if (!chord_distances(code, length)) {
+        return false;
+    }
+
+    rotate_renumber(code, length, least_rotation(code, length), out);
+    return true;
+}
+
+// batches smaller than this aren't worth waking up threads for
+static const size_t batch_parallel_min = 256;
+
+// the same as canonicalize_code, but also handles codes which aren't
+// chord diagrams
+void canonicalize_any_code(const code_elem_t* code, size_t length, code_elem_t* out)
+{
+    if (canonicalize_code(code, length, out)) {
+        return;
+    }
+
+    code_t copy(code, code + length);
+    code_elem_t max = 0;
+    for (auto iter: copy) {
+        max = std::max(max, (code_elem_t) ELEM_ID(iter));
+    }
+
+    renumber_code(copy, max + 1);
+    copy = first_ordered_code_quadratic(copy);
+    std::copy(copy.begin(), copy.end(), out);
+}
+
+// renumbers and orders each of the raw codes, in parallel for big enough
+// batches, onto the end of out (in the same order)
+void canonicalize_codes(const std::vector<code_t>& raw, code_list_t& out)
+{
+    // lengths don't change, so everything's position is known up front
+    size_t count = raw.size(), first = code_list_size(out);
+    out.offsets.resize(first + count + 1);
+    for (size_t i = 0; i < count; i++) {
+        out.offsets[first + i + 1] = out.offsets[first + i] + raw[i].size();
+    }
+    out.elems.resize(out.offsets.back());
+
+    #pragma omp parallel for schedule(static) if (count >= batch_parallel_min)
+    for (size_t i = 0; i < count; i++) {
+        canonicalize_any_code(raw[i].data(), raw[i].size(), &out.elems[out.offsets[first + i]]);
+    }
+}
+
+void canonicalize_codes(const code_list_t& raw, code_list_t& out)
+{
+    size_t count = code_list_size(raw), first = code_list_size(out), base = out.elems.size();
+    out.offsets.resize(first + count + 1);
+    for (size_t i = 0; i < count; i++) {
+        out.offsets[first + i + 1] = base + raw.offsets[i + 1];
+    }
+    out.elems.resize(base + raw.elems.size());
+
+    #pragma omp parallel for schedule(static) if (count >= batch_parallel_min)
+    for (size_t i = 0; i < count; i++) {
+        canonicalize_any_code(code_list_elems(raw, i), code_list_length(raw, i),
+                              &out.elems[out.offsets[first + i]]);
+    }
+}
+
+// pick the first of them based on the ordering from compare_codes
+code_t first_ordered_code(code_t code)
+{
+    code_t first(code.size());
+    if (!canonicalize_code(code.data(), code.size(), first.data())) {
+        return first_ordered_code_quadratic(code);
+    }
+
+    return first;
+}
+
+packed_code_t first_ordered_code(const packed_code_t& code)
+{
+    code_elem_t elems[2 * PACKED_MAX_CHORDS], first[2 * PACKED_MAX_CHORDS];
+    size_t length = unpack_code(code, elems);
+    if (!canonicalize_code(elems, length, first)) {
+        return pack_code(first_ordered_code_quadratic(code_t(elems, elems + length)));
+    }
+
+    return pack_code(first, length);
+}
+
+#ifdef FLAT_KNOTS
+#define ELEM_SWAP_MASK  ELEM_SIGN_MASK
+#else
+#define ELEM_SWAP_MASK  ELEM_OU_MASK
+#endif
+
+// apply a symmetry to a code, without renumbering it
+static void apply_symmetry(const code_elem_t* code, size_t length, int symmetry, code_elem_t* out)
+{
+    for (size_t i = 0; i < length; i++) {
+        code_elem_t e = (symmetry & SYMMETRY_REVERSE) ? code[length - 1 - i] : code[i];
+        if (symmetry & SYMMETRY_SWAP) {
+            e ^= ELEM_SWAP_MASK;
+        }
+        out[i] = e;
+    }
+}
+
+// write the least first ordered code out of every symmetry of code into
+// out, using scratch and cand as space for length elements each
+// returns false if code isn't a chord diagram
+static bool first_symmetric_code(const code_elem_t* code, size_t length, code_elem_t* out,
+                                 code_elem_t* scratch, code_elem_t* cand)
+{
+    if (!canonicalize_code(code, length, out)) {
+        return false;
+    }
+
+    for (int symmetry = 1; symmetry < SYMMETRIES; symmetry++) {
+        apply_symmetry(code, length, symmetry, scratch);
+        canonicalize_code(scratch, length, cand);
+        if (std::lexicographical_compare(cand, cand + length, out, out + length)) {
+            std::copy(cand, cand + length, out);
+        }
+    }
+
+    return true;
+}
+
+// apply the symmetry to the code, then renumber and order it
+code_t symmetric_code(const code_t& code, int symmetry)
+{
+    code_t moved(code.size());
+    apply_symmetry(code.data(), code.size(), symmetry, moved.data());
+    return first_ordered_code(moved);
+}
+
+// the least first ordered code out of every symmetry of code
+code_t first_symmetric_code(const code_t& code)
+{
+    static thread_local std::vector<code_elem_t> scratch, cand;
+    scratch.resize(code.size()); cand.resize(code.size());
+
+    code_t first(code.size());
+    if (!first_symmetric_code(code.data(), code.size(), first.data(), scratch.data(), cand.data())) {
+        return first_ordered_code(code);
+    }
+
+    return first;
+}
+
+packed_code_t first_symmetric_code(const packed_code_t& code)
+{
+    code_elem_t elems[2 * PACKED_MAX_CHORDS], first[2 * PACKED_MAX_CHORDS],
+                scratch[2 * PACKED_MAX_CHORDS], cand[2 * PACKED_MAX_CHORDS];
+    size_t length = unpack_code(code, elems);
+    if (!first_symmetric_code(elems, length, first, scratch, cand)) {
+        return first_ordered_code(code);
+    }
+
+    return pack_code(first, length);
+}
+
+#ifdef TEST_CANONICAL
+// the same random block of chords over and over, with the ends of one
+// chord swapped, so its rotations stay tied for a long way before the one
+// different chord tells them apart
+static code_t random_periodic_code(size_t block, size_t repeats)
+{
+    code_t unit = random_code(block), code;
+    for (size_t r = 0; r < repeats; r++) {
+        for (auto elem: unit) {
+            code.push_back(elem + ((code_elem_t) (r * block) << ELEM_ID_SHIFT));
+        }
+    }
+
+    code_elem_t id = ELEM_ID(code[rand() % code.size()]);
+    for (auto& elem: code) {
+        if (ELEM_ID(elem) == id) {
+            elem ^= ELEM_POSITIVE;
+        }
+    }
+
+    return code;
+}
+
+// check first_ordered_code against trying every rotation, and that every
+// symmetry of a code has the same first_symmetric_code, on random codes of
+// up to max_length chords
+bool test_canonical(size_t rounds, size_t max_length)
+{
+    for (size_t i = 0; i < rounds; i++) {
+        // random codes almost never have rotations which stay tied, so
+        // every other one is nearly periodic
+        code_t code = (i & 1) ? random_periodic_code(rand() % 3 + 1, rand() % (4 * max_length) + 1)
+                              : random_code(rand() % max_length + 1);
+        // scramble it up a bit so it isn't already first
+        code = rotate_code(code, rand() % code.size());
+
+        code_t fast = first_ordered_code(code), slow = first_ordered_code_quadratic(code);
+        if (compare_codes(fast, slow)) {
+            std::cout << "Mismatch on " << stringify_code(code) << ": " << stringify_code(fast)
+                      << " vs " << stringify_code(slow) << std::endl;
+            return false;
+        }
+
+        // every symmetry of a code has to come back to the same one
+        code_t first = first_symmetric_code(code);
+        for (int symmetry = 1; symmetry < SYMMETRIES; symmetry++) {
+            code_t image = symmetric_code(code, symmetry);
+            if (compare_codes(first_symmetric_code(image), first)) {
+                std::cout << "Symmetry " << symmetry << " of " << stringify_code(code)
+                          << " has a different representative" << std::endl;
+                return false;
+            }
+
+            if (packed_fits(image.size()) &&
+                compare_codes(unpack_code(first_symmetric_code(pack_code(image))), first)) {
+                std::cout << "Packed symmetry " << symmetry << " of " << stringify_code(code)
+                          << " has a different representative" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+#endif
+
+// fill out with a random code of chords chords, which isn't renumbered or
+// ordered
+void random_raw_code(size_t chords, std::mt19937_64& rng, code_elem_t* out)
+{
+    for (size_t i = 0; i < chords; i++) {
 #ifndef FLAT_KNOTS
         code_elem_t elem = (i << ELEM_ID_SHIFT);
-        if (rand() % 2) elem |= ELEM_POSITIVE;
-        c.push_back(elem); c.push_back(elem | ELEM_OVER);
+        if (rng() & 1) elem |= ELEM_POSITIVE;
+        out[2 * i] = elem; out[2 * i + 1] = elem | ELEM_OVER;
 #else
         code_elem_t elem = (i << ELEM_ID_SHIFT);
-        c.push_back(elem); c.push_back(elem | ELEM_POSITIVE);
+        out[2 * i] = elem; out[2 * i + 1] = elem | ELEM_POSITIVE;
 #endif
     }
 
-    std::random_shuffle(c.begin(), c.end());
-    renumber_code(c, max_length);
-    return first_ordered_code(c);
+    std::shuffle(out, out + 2 * chords, rng);
+}
+
+code_t random_code(size_t max_length, std::mt19937_64& rng)
+{
+    // get a random code of max_length
+    code_t c(2 * max_length), first(2 * max_length);
+    random_raw_code(max_length, rng, c.data());
+    canonicalize_code(c.data(), c.size(), first.data());
+    return first;
+}
+
+code_t random_code(size_t max_length)
+{
+    static thread_local std::mt19937_64 rng(rand());
+    return random_code(max_length, rng);
 }
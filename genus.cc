@@ -1,8 +1,260 @@
 #include <cassert>
 #include "gauss.h"
+#include "genus.h"
+#include <immintrin.h>
+#include <iostream>
 #include <set>
 #include <tuple>
+#include <vector>
 
+#ifndef FLAT_KNOTS
+// half-edges are numbered 2 * i for the one leaving position i forwards,
+// and 2 * i + 1 for the one leaving position i backwards
+static thread_local std::vector<size_t> partner, opened;
+static thread_local std::vector<uint32_t> successor;
+static thread_local std::vector<uint64_t> visited;
+
+// fill successor with the half-edge which comes after each one going
+// around a face
+static void trace_successors(const code_elem_t* code, size_t length)
+{
+    static const size_t none = -1;
+
+    code_elem_t max = 0;
+    for (size_t i = 0; i < length; i++) {
+        max = std::max(max, ELEM_ID(code[i]));
+    }
+    opened.assign(max + 1, none);
+    partner.resize(length);
+
+    for (size_t i = 0; i < length; i++) {
+        code_elem_t id = ELEM_ID(code[i]);
+        if (opened[id] == none) {
+            opened[id] = i;
+        } else {
+            partner[i] = opened[id]; partner[opened[id]] = i;
+        }
+    }
+
+    successor.resize(2 * length);
+    for (size_t h = 0; h < 2 * length; h++) {
+        // where the half-edge gets to, and which way it's going
+        bool forwards = !(h & 1);
+        size_t at = forwards ? (h / 2 + 1) % length : (h / 2 + length - 1) % length;
+
+        // turn right onto the other strand through the crossing: coming in
+        // over keeps going the same way along it for positive crossings,
+        // and coming in under the other way
+        bool turn = (code[at] & ELEM_OVER) ? (code[at] & ELEM_POSITIVE) : !(code[at] & ELEM_POSITIVE);
+        successor[h] = 2 * partner[at] + (forwards == (bool) turn ? 0 : 1);
+    }
+}
+
+// the number of faces the code's diagram has
+static size_t count_faces(const code_elem_t* code, size_t length)
+{
+    trace_successors(code, length);
+
+    size_t half_edges = 2 * length;
+    visited.assign((half_edges + 63) / 64, 0);
+
+    size_t faces = 0;
+    for (size_t h = 0; h < half_edges; h++) {
+        if (visited[h / 64] & (1ull << (h % 64))) {
+            continue;
+        }
+
+        // go around the face
+        size_t e = h;
+        do {
+            visited[e / 64] |= 1ull << (e % 64);
+            e = successor[e];
+        } while (e != h);
+
+        faces++;
+    }
+
+    return faces;
+}
+
+// label each half-edge with the face it goes around, returning how many
+// faces there are
+size_t code_faces(const code_elem_t* code, size_t length, std::vector<uint32_t>& faces)
+{
+    trace_successors(code, length);
+
+    static const uint32_t none = -1;
+    faces.assign(2 * length, none);
+
+    size_t count = 0;
+    for (size_t h = 0; h < 2 * length; h++) {
+        if (faces[h] != none) {
+            continue;
+        }
+
+        size_t e = h;
+        do {
+            faces[e] = count;
+            e = successor[e];
+        } while (e != h);
+
+        count++;
+    }
+
+    return count;
+}
+
+// returns the genus of the code
+int genus(const code_elem_t* code, size_t length)
+{
+    // from https://arxiv.org/pdf/math/0610929.pdf, with V - E + F = 2 - 2g
+    // where there are 2 edges for every vertex
+    if (!length) {
+        return 0;
+    }
+
+    size_t vertices = length / 2;
+    return (int) (2 + vertices - count_faces(code, length)) / 2;
+}
+
+int genus(const code_t& code)
+{
+    return genus(code.data(), code.size());
+}
+
+// codes go through the vector version this many at a time, a lane each
+#define GENUS_LANES     8
+
+// GENUS_LANES codes side by side, with element i of lane k at
+// i * GENUS_LANES + k, along with the other end of each element
+// their half-edges are laid out the same way, with successors to jump
+// along and labels, and scratch for the next round of each
+static thread_local std::vector<int32_t> lane_code, lane_partner;
+static thread_local std::vector<int32_t> lane_jump, lane_label, lane_next_jump, lane_next_label;
+
+// put every lane's code and the other end of each of its elements side by
+// side
+static void load_lanes(const code_elem_t* codes, size_t length)
+{
+    static const size_t none = -1;
+
+    lane_code.resize(length * GENUS_LANES); lane_partner.resize(length * GENUS_LANES);
+    for (size_t k = 0; k < GENUS_LANES; k++) {
+        const code_elem_t* code = codes + k * length;
+
+        code_elem_t max = 0;
+        for (size_t i = 0; i < length; i++) {
+            max = std::max(max, ELEM_ID(code[i]));
+        }
+        opened.assign(max + 1, none);
+
+        for (size_t i = 0; i < length; i++) {
+            code_elem_t id = ELEM_ID(code[i]);
+            lane_code[i * GENUS_LANES + k] = code[i];
+            if (opened[id] == none) {
+                opened[id] = i;
+            } else {
+                lane_partner[i * GENUS_LANES + k] = opened[id];
+                lane_partner[opened[id] * GENUS_LANES + k] = i;
+            }
+        }
+    }
+}
+
+// the genus of GENUS_LANES codes of the same length at once
+// successors are worked out as in trace_successors, but where each
+// half-edge gets to is the same for every lane, so it's a lane-wise load
+// then a face is counted at its least half-edge: after r rounds of pointer
+// jumping each half-edge is labelled with the least of the 2^r half-edges
+// starting from it, so once 2^r is at least the number of half-edges, the
+// ones labelled by themselves are one to a face
+// that only needs gathers, which AVX2 has (unlike scatters, which marking
+// half-edges visited would need)
+__attribute__((target("avx2")))
+static void lanes_genera_avx2(const code_elem_t* codes, size_t length, int* out)
+{
+    size_t half_edges = 2 * length;
+    load_lanes(codes, length);
+
+    lane_jump.resize(half_edges * GENUS_LANES); lane_label.resize(half_edges * GENUS_LANES);
+    lane_next_jump.resize(half_edges * GENUS_LANES); lane_next_label.resize(half_edges * GENUS_LANES);
+
+    const __m256i one = _mm256_set1_epi32(1);
+    for (size_t i = 0; i < length; i++) {
+        size_t next = (i + 1 == length) ? 0 : i + 1, prev = i ? i - 1 : length - 1;
+
+        // turning right keeps going the same way when O and sign agree, so
+        // going forwards the new half-edge is backwards when they don't,
+        // and going backwards it's backwards when they do
+        __m256i c = _mm256_loadu_si256((const __m256i*) &lane_code[next * GENUS_LANES]);
+        __m256i p = _mm256_loadu_si256((const __m256i*) &lane_partner[next * GENUS_LANES]);
+        __m256i differ = _mm256_and_si256(_mm256_xor_si256(c, _mm256_srli_epi32(c, 1)), one);
+        _mm256_storeu_si256((__m256i*) &lane_jump[2 * i * GENUS_LANES],
+                            _mm256_add_epi32(_mm256_slli_epi32(p, 1), differ));
+
+        c = _mm256_loadu_si256((const __m256i*) &lane_code[prev * GENUS_LANES]);
+        p = _mm256_loadu_si256((const __m256i*) &lane_partner[prev * GENUS_LANES]);
+        differ = _mm256_and_si256(_mm256_xor_si256(c, _mm256_srli_epi32(c, 1)), one);
+        _mm256_storeu_si256((__m256i*) &lane_jump[(2 * i + 1) * GENUS_LANES],
+                            _mm256_add_epi32(_mm256_slli_epi32(p, 1), _mm256_xor_si256(differ, one)));
+    }
+
+    for (size_t h = 0; h < half_edges; h++) {
+        _mm256_storeu_si256((__m256i*) &lane_label[h * GENUS_LANES], _mm256_set1_epi32(h));
+    }
+
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (size_t reach = 1; reach < half_edges; reach *= 2) {
+        const int* jump = lane_jump.data();
+        const int* label = lane_label.data();
+        for (size_t h = 0; h < half_edges; h++) {
+            __m256i j = _mm256_loadu_si256((const __m256i*) (jump + h * GENUS_LANES));
+            __m256i at = _mm256_add_epi32(_mm256_slli_epi32(j, 3), lanes);
+
+            __m256i l = _mm256_loadu_si256((const __m256i*) (label + h * GENUS_LANES));
+            l = _mm256_min_epi32(l, _mm256_i32gather_epi32(label, at, 4));
+            _mm256_storeu_si256((__m256i*) &lane_next_label[h * GENUS_LANES], l);
+            _mm256_storeu_si256((__m256i*) &lane_next_jump[h * GENUS_LANES],
+                                _mm256_i32gather_epi32(jump, at, 4));
+        }
+
+        lane_jump.swap(lane_next_jump); lane_label.swap(lane_next_label);
+    }
+
+    __m256i faces = _mm256_setzero_si256();
+    for (size_t h = 0; h < half_edges; h++) {
+        __m256i l = _mm256_loadu_si256((const __m256i*) &lane_label[h * GENUS_LANES]);
+        // equal lanes are all ones, so subtracting counts them
+        faces = _mm256_sub_epi32(faces, _mm256_cmpeq_epi32(l, _mm256_set1_epi32(h)));
+    }
+
+    int32_t counts[GENUS_LANES];
+    _mm256_storeu_si256((__m256i*) counts, faces);
+    for (size_t k = 0; k < GENUS_LANES; k++) {
+        out[k] = (int) (2 + length / 2 - counts[k]) / 2;
+    }
+}
+
+// the genus of count codes of length elements each, stored back to back,
+// into out
+void code_genera(const code_elem_t* codes, size_t count, size_t length, int* out)
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+
+    size_t i = 0;
+    if (avx2 && length) {
+        for (; i + GENUS_LANES <= count; i += GENUS_LANES) {
+            lanes_genera_avx2(codes + i * length, length, out + i);
+        }
+    }
+
+    for (; i < count; i++) {
+        out[i] = genus(codes + i * length, length);
+    }
+}
+#endif
+
+#ifdef TEST_GENUS
 enum sign_t {
     POSITIVE = +1, NONE = 0, NEGATIVE = -1
 };
@@ -49,8 +301,8 @@ typedef struct edge {
 } edge_t;
 
 #ifndef FLAT_KNOTS
-// takes in a gauss code and returns true if it's planar/classical
-int genus(const code_t& input_code)
+// the genus, going around faces by looking up half-edges in a set
+static int genus_traced(const code_t& input_code)
 {
     // return the genus of the diagram
     // from https://arxiv.org/pdf/math/0610929.pdf
@@ -127,4 +379,21 @@ int genus(const code_t& input_code)
 
     return (2 - (faces - vertices)) / 2;
 }
+
+// check genus against going around faces the slow way, on random codes of
+// up to max_length chords
+bool test_genus(size_t rounds, size_t max_length)
+{
+    for (size_t i = 0; i < rounds; i++) {
+        code_t code = random_code(rand() % max_length + 1);
+        if (genus(code) != genus_traced(code)) {
+            std::cout << "Mismatch on " << stringify_code(code) << ": " << genus(code)
+                      << " vs " << genus_traced(code) << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+#endif
 #endif
@@ -0,0 +1,14 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <cstdint>
+#include <ostream>
+
+// times parsing, canonicalizing, genus/planarity and each kind of move on
+// random codes of 8 chords, doubling up to max_chords, and writes a line of
+// microseconds for each size, to show how they scale
+// enumerating R2 undo moves gives back 8n^2 codes of 2n elements, so it's
+// only timed up to bench_r2_undo_max chords
+void bench_scaling(size_t max_chords, uint64_t seed, std::ostream& out);
+
+#endif /* _BENCH_H */
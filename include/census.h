@@ -0,0 +1,54 @@
+#ifndef _CENSUS_H
+#define _CENSUS_H
+
+#include "gauss.h"
+#include <functional>
+#include <vector>
+
+// enumerates every first ordered code with a given number of chords exactly
+// once, in increasing order, without remembering what it's already seen
+// codes are built up an element at a time in order, and a partial code is
+// dropped as soon as some rotation of it is known to come first, so only
+// first ordered codes are ever completed
+// a census can be restricted to codes starting with a prefix (to split the
+// work up, see census_prefixes), and resumed after any code it gave out
+
+typedef struct census_t {
+    size_t chords;
+    // leading elements of code which were given, and never change
+    size_t fixed;
+    // the code built so far
+    code_t code;
+
+    // where each chord was opened, by id
+    std::vector<size_t> opened;
+    // the other end of each element, by position, once both are placed
+    std::vector<size_t> partner;
+    // for each rotation start, the position where it stopped matching
+    // code, or -1 if it still matches
+    std::vector<size_t> untied;
+    code_elem_t next_id;
+    size_t open;
+
+    bool started;
+    bool done;
+} census_t;
+
+// start a census of codes with chords chords which begin with prefix
+void census_start(census_t& census, size_t chords, const code_t& prefix = code_t());
+
+// start a census which picks up after last, a code given out by a census
+// with the same chords and prefix
+void census_resume(census_t& census, size_t chords, const code_t& prefix, const code_t& last);
+
+// the next code in the census, or false once it's done
+bool census_next(census_t& census, code_t& out);
+
+// every prefix of length depth which some first ordered code with chords
+// chords starts with, in order, for handing out to separate workers
+std::vector<code_t> census_prefixes(size_t chords, size_t depth);
+
+// every first ordered code with up to max_chords chords
+void census_all(size_t max_chords, const std::function<void(const code_t&)>& callback);
+
+#endif /* _CENSUS_H */
@@ -0,0 +1,68 @@
+#ifndef _CODESET_H
+#define _CODESET_H
+
+#include "gauss.h"
+#include <string>
+#include <vector>
+
+// a file of sorted canonical codes, which can be searched straight out of
+// memory
+// laid out as a header, then a sparse index holding every
+// CODESET_STRIDE'th record, then the records themselves; a record is the
+// first record_words words of a packed code, which is enough to hold the
+// largest code in the file
+// everything is in native byte order
+
+#define CODESET_MAGIC       0x7365646f63686d77ull   // "wmhcodes"
+#define CODESET_VERSION     1
+#define CODESET_STRIDE      256
+
+#define CODESET_CLASSICAL   0
+#define CODESET_FLAT        1
+
+#define CODESET_NONE        ((size_t) -1)
+
+typedef struct codeset_header_t {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t flavor;
+    // most chords of any code in the file
+    uint32_t chords;
+    uint32_t record_words;
+    uint64_t count;
+    uint64_t index_count;
+    // in bytes from the start of the file
+    uint64_t index_offset;
+    uint64_t records_offset;
+} codeset_header_t;
+
+typedef struct codeset_t {
+    void* map;
+    size_t size;
+    const codeset_header_t* header;
+    const uint64_t* index;
+    const uint64_t* records;
+} codeset_t;
+
+// writes the codes (which must be canonical) out sorted and without
+// duplicates
+// returns false if the file couldn't be written
+bool write_codeset(const std::string& path, std::vector<packed_code_t> codes);
+
+// maps a file written by write_codeset
+// returns false if it can't be read, or is for the other flavor of knots
+bool open_codeset(const std::string& path, codeset_t& set);
+void close_codeset(codeset_t& set);
+
+size_t codeset_size(const codeset_t& set);
+packed_code_t codeset_get(const codeset_t& set, size_t i);
+
+// where the (canonical) code is in the set, or CODESET_NONE
+// since the records are sorted and distinct, this numbers the codes in a
+// file densely, the same way a rank table does (see rank.h)
+size_t codeset_find(const codeset_t& set, const packed_code_t& code);
+
+// if the (canonical) code is in the set
+bool codeset_contains(const codeset_t& set, const packed_code_t& code);
+
+#endif /* _CODESET_H */
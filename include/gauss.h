@@ -1,10 +1,13 @@
 #ifndef _GAUSS_H
 #define _GAUSS_H
 
+#include <cstdint>
+#include <random>
 #include <string>
 #include <vector>
 
 // #define FLAT_KNOTS
+// #define TEST_CANONICAL
 
 typedef unsigned int code_elem_t;
 
@@ -38,18 +41,169 @@ typedef unsigned int code_elem_t;
 
 typedef std::vector<code_elem_t> code_t;
 
+// a renumbered code packed into a few words, for storing lots of them
+// elements are PACKED_ELEM_BITS wide, PACKED_WORD_ELEMS to a word with the
+// first element in the most significant bits, and the top bits of the
+// first word hold the number of chords, so comparing words in order
+// compares the same way compare_codes does
+#define PACKED_ELEM_BITS    6
+#define PACKED_WORD_ELEMS   10
+#define PACKED_WORDS        3
+#define PACKED_MAX_CHORDS   15
+
+#define PACKED_ELEM_MASK    ((1 << PACKED_ELEM_BITS) - 1)
+#define PACKED_CHORDS_SHIFT (PACKED_ELEM_BITS * PACKED_WORD_ELEMS)
+
+typedef struct packed_code_t {
+    uint64_t words[PACKED_WORDS];
+
+    bool operator <(const struct packed_code_t& b) const
+    {
+        for (int i = 0; i < PACKED_WORDS; i++) {
+            if (words[i] != b.words[i]) return words[i] < b.words[i];
+        }
+
+        return false;
+    }
+
+    bool operator ==(const struct packed_code_t& b) const
+    {
+        for (int i = 0; i < PACKED_WORDS; i++) {
+            if (words[i] != b.words[i]) return false;
+        }
+
+        return true;
+    }
+
+    bool operator !=(const struct packed_code_t& b) const
+    {
+        return !(*this == b);
+    }
+} packed_code_t;
+
+// a list of codes stored back to back, where code i is the elements from
+// offsets[i] up to offsets[i + 1]
+typedef struct code_list_t {
+    std::vector<size_t> offsets{0};
+    std::vector<code_elem_t> elems;
+} code_list_t;
+
+static inline size_t code_list_size(const code_list_t& list)
+{
+    return list.offsets.size() - 1;
+}
+
+static inline size_t code_list_length(const code_list_t& list, size_t i)
+{
+    return list.offsets[i + 1] - list.offsets[i];
+}
+
+static inline const code_elem_t* code_list_elems(const code_list_t& list, size_t i)
+{
+    return list.elems.data() + list.offsets[i];
+}
+
+void code_list_clear(code_list_t& list);
+void code_list_push(code_list_t& list, const code_elem_t* code, size_t length);
+code_t code_list_get(const code_list_t& list, size_t i);
+std::vector<code_t> code_list_codes(const code_list_t& list);
+
+// largest id scan_code accepts
+#define SCAN_MAX_ID     ((1 << 24) - 1)
+
+// scan the elements of a code out of [begin, end) into out, which needs
+// room for (end - begin) / 2 elements, without renumbering them
+// returns NULL on success, or where the first bad character is
+const char* scan_code(const char* begin, const char* end, code_elem_t* out, size_t* length);
+
 // parse the string and return the code
 code_t parse_code(const std::string& s);
+packed_code_t parse_packed_code(const std::string& s);
 
 std::string stringify_code(const code_t& code);
+std::string stringify_code(const packed_code_t& code);
 void display_code(const code_t& code);
+void display_code(const packed_code_t& code);
+
+// if a code of length elements has few enough chords to be packed
+static inline bool packed_fits(size_t length)
+{
+    return length <= 2 * PACKED_MAX_CHORDS;
+}
+
+// packs a renumbered code of at most PACKED_MAX_CHORDS chords, which has
+// to be checked with packed_fits first
+packed_code_t pack_code(const code_elem_t* code, size_t length);
+packed_code_t pack_code(const code_t& code);
+code_t unpack_code(const packed_code_t& code);
+
+// number of elements in a packed code, and the element at i
+static inline size_t packed_length(const packed_code_t& code)
+{
+    return (code.words[0] >> PACKED_CHORDS_SHIFT) * 2;
+}
+
+static inline code_elem_t packed_elem(const packed_code_t& code, size_t i)
+{
+    size_t shift = PACKED_ELEM_BITS * (PACKED_WORD_ELEMS - 1 - i % PACKED_WORD_ELEMS);
+    return (code.words[i / PACKED_WORD_ELEMS] >> shift) & PACKED_ELEM_MASK;
+}
 
 void renumber_code(code_t &code, code_elem_t max_id);
+void renumber_code(packed_code_t &code);
 code_t first_ordered_code(code_t code);
+packed_code_t first_ordered_code(const packed_code_t& code);
+
+// symmetries which every move commutes with, so they can be quotiented
+// out of the graph: reversing the orientation, and swapping every over
+// with under (or for flat knots, every left with right)
+// mirroring the crossing signs is left out, since the R3 moves aren't
+// closed under it
+#define SYMMETRY_REVERSE    (1 << 0)
+#define SYMMETRY_SWAP       (1 << 1)
+#define SYMMETRIES          4
+
+// apply the symmetry to the code, then renumber and order it
+code_t symmetric_code(const code_t& code, int symmetry);
+
+// the least first ordered code out of every symmetry of code
+code_t first_symmetric_code(const code_t& code);
+packed_code_t first_symmetric_code(const packed_code_t& code);
+
+// rotate the code left by num and renumber it
+packed_code_t rotate_code(const packed_code_t& code, size_t num);
+
+// writes the first ordered rotation of code (which doesn't need to be
+// renumbered) into out, which can't overlap code
+// returns false if code isn't a chord diagram, leaving out untouched
+bool canonicalize_code(const code_elem_t* code, size_t length, code_elem_t* out);
+
+// the same, but also handles codes which aren't chord diagrams
+void canonicalize_any_code(const code_elem_t* code, size_t length, code_elem_t* out);
+
+// renumbers and orders each of the raw codes, in parallel for big enough
+// batches, onto the end of out (in the same order)
+void canonicalize_codes(const std::vector<code_t>& raw, code_list_t& out);
+void canonicalize_codes(const code_list_t& raw, code_list_t& out);
 
 // negative if a < b, positive if a > b, 0 if equal
 int compare_codes(const code_t& a, const code_t& b);
+int compare_codes(const packed_code_t& a, const packed_code_t& b);
+
+// fill out with a random code of chords chords, which isn't renumbered or
+// ordered
+void random_raw_code(size_t chords, std::mt19937_64& rng, code_elem_t* out);
 
+// a random code of max_length chords, from rng, or from a generator
+// seeded off rand() for each thread
+code_t random_code(size_t max_length, std::mt19937_64& rng);
 code_t random_code(size_t max_length);
 
+#ifdef TEST_CANONICAL
+// check first_ordered_code against trying every rotation, and that every
+// symmetry of a code has the same first_symmetric_code, on random codes of
+// up to max_length chords
+bool test_canonical(size_t rounds, size_t max_length);
+#endif
+
 #endif /* _GAUSS_H */
@@ -2,8 +2,32 @@
 #define _GENUS_H
 
 #include "gauss.h"
+#include <vector>
 
-// takes in a gauss code and returns its genus
-int genus(const code_t& input_code);
+// #define TEST_GENUS
+
+// takes in a gauss code and returns its genus, going around the faces of
+// its diagram as cycles of a permutation of half-edges
+// it's linear and doesn't allocate once its scratch space has grown, so
+// it isn't worth caching
+// safe to call from several threads at once
+int genus(const code_elem_t* code, size_t length);
+int genus(const code_t& code);
+
+// the genus of each of count codes of length elements, stored back to back,
+// into out, going across several codes at once with AVX2 if it's there
+void code_genera(const code_elem_t* codes, size_t count, size_t length, int* out);
+
+// label each half-edge of the code's diagram with the face it goes around,
+// where half-edge 2 * i leaves position i forwards and 2 * i + 1 leaves it
+// backwards, and return how many faces there are
+// the genus is then (2 + length / 2 - faces) / 2
+size_t code_faces(const code_elem_t* code, size_t length, std::vector<uint32_t>& faces);
+
+#ifdef TEST_GENUS
+// check genus against going around faces the slow way, on random codes of
+// up to max_length chords
+bool test_genus(size_t rounds, size_t max_length);
+#endif
 
 #endif /* _GENUS_H */
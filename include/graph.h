@@ -2,6 +2,7 @@
 #define _GRAPH_H
 
 #include "gauss.h"
+#include "invariant.h"
 #include <set>
 #include <unordered_set>
 #include <vector>
@@ -11,13 +12,17 @@
 // #define TEST_MENU
 // #define TEST_MENU_LIST
 // #define TEST_BRUTE
+// #define TEST_HASH_STATS
 #define TEST_ANY_RETRACTION
 
+// only keep one node for every code and its symmetries
+// #define SYMMETRY_REDUCED
+
 typedef struct menu_t {
     std::set<struct node_t*> menu;
 
 #ifdef TEST_MENU_LIST
-    std::vector<code_t> list;
+    std::vector<packed_code_t> list;
 #endif
 
     bool operator <(const struct menu_t& b) const
@@ -27,11 +32,15 @@ typedef struct menu_t {
 } menu_t;
 
 typedef struct node_t {
-    code_t code;
+    packed_code_t code;
     bool planar;
 
 #ifdef TEST_BRUTE
     size_t index;
+
+    // cheap invariants, worked out the first time they're needed
+    invariants_t invariants;
+    bool invariants_known;
 #endif
 
     // subdiagrams
@@ -41,10 +50,18 @@ typedef struct node_t {
     // if we've prunified this
     bool pruneify;
 
+    // only some of the neighbors (the special or planar ones) until
+    // neighbors_explored is set
     std::unordered_set<struct node_t*> neighbors;
     bool sneighbors_explored;
     bool neighbors_explored;
 
+#ifndef FLAT_KNOTS
+    // the planar neighbors, once planar_neighbors_explored is set
+    std::vector<struct node_t*> planar_neighbors;
+    bool planar_neighbors_explored;
+#endif
+
     std::set<menu_t> menus;
 } node_t;
 
@@ -0,0 +1,64 @@
+#ifndef _HASH_H
+#define _HASH_H
+
+#include "gauss.h"
+#include <functional>
+
+// 64-bit hashing of codes, mixing in the style of wyhash: every word is
+// folded in with a full 64x64->128 multiply, so all the bits of the
+// result depend on all the bits of the code
+
+static const uint64_t hash_secret[4] = {
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull,
+    0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+};
+
+// multiply, and fold the high half onto the low half
+static inline uint64_t hash_mum(uint64_t a, uint64_t b)
+{
+    __uint128_t r = (__uint128_t) a * b;
+    return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+static inline uint64_t hash_code(const packed_code_t& code)
+{
+    uint64_t seed = hash_mum(code.words[0] ^ hash_secret[0], code.words[1] ^ hash_secret[1]);
+    return hash_mum(seed ^ hash_secret[2], code.words[2] ^ hash_secret[3]);
+}
+
+static inline uint64_t hash_code(const code_elem_t* code, size_t length)
+{
+    // two elements to a word
+    uint64_t seed = hash_secret[0] ^ length;
+    size_t i = 0;
+    for (; i + 1 < length; i += 2) {
+        uint64_t word = ((uint64_t) code[i] << 32) | code[i + 1];
+        seed = hash_mum(seed ^ hash_secret[1], word ^ hash_secret[2]);
+    }
+
+    if (i < length) {
+        seed = hash_mum(seed ^ hash_secret[1], (uint64_t) code[i] ^ hash_secret[2]);
+    }
+
+    return hash_mum(seed ^ hash_secret[3], length ^ hash_secret[0]);
+}
+
+namespace std {
+    template <>
+    struct hash<code_t> {
+        size_t operator()(const code_t& k) const
+        {
+            return hash_code(k.data(), k.size());
+        }
+    };
+
+    template <>
+    struct hash<packed_code_t> {
+        size_t operator()(const packed_code_t& k) const
+        {
+            return hash_code(k);
+        }
+    };
+}
+
+#endif /* _HASH_H */
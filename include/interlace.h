@@ -0,0 +1,67 @@
+#ifndef _INTERLACE_H
+#define _INTERLACE_H
+
+#include "gauss.h"
+#include <vector>
+
+// #define TEST_INTERLACE
+
+// which chords of a code interlace (have exactly one end between the ends
+// of the other), as a bit matrix over chord ids, along with where the ends
+// of every chord are and which chord is at every position
+// questions about interlacement are then ANDs, XORs and popcounts of rows
+// ids don't need to be renumbered: ones which don't appear just have no
+// ends and empty rows
+
+#define INTERLACE_NONE  ((size_t) -1)
+
+typedef struct interlace_t {
+    // room for ids up to this, and words in each row
+    size_t ids;
+    size_t words;
+    size_t length;
+
+    // bit b of row a (ids * words words) if a and b interlace
+    std::vector<uint64_t> rows;
+    // ends of each id, in order, or INTERLACE_NONE
+    std::vector<size_t> ends;
+    // the id at each position
+    std::vector<size_t> at;
+} interlace_t;
+
+void interlace_build(interlace_t& m, const code_elem_t* code, size_t length);
+
+static inline const uint64_t* interlace_row(const interlace_t& m, size_t id)
+{
+    return &m.rows[id * m.words];
+}
+
+static inline bool interlaced(const interlace_t& m, size_t a, size_t b)
+{
+    return (interlace_row(m, a)[b / 64] >> (b % 64)) & 1;
+}
+
+// the other end of the chord at position p
+static inline size_t interlace_partner(const interlace_t& m, size_t p)
+{
+    size_t id = m.at[p];
+    return (m.ends[2 * id] == p) ? m.ends[2 * id + 1] : m.ends[2 * id];
+}
+
+// how many chords the chord interlaces; a chord is odd if this is, and a
+// planar diagram has none
+size_t interlace_degree(const interlace_t& m, size_t id);
+size_t interlace_odd_chords(const interlace_t& m);
+
+// if every chord in the set (a bitmap over ids, of m.words words)
+// interlaces an even number of the others in the set, which the
+// subdiagram of those chords needs to be planar
+bool interlace_even(const interlace_t& m, const uint64_t* set);
+
+#ifdef TEST_INTERLACE
+// check the matrix of random codes of up to max_length chords against
+// looking at the ends of every pair of chords
+bool test_interlace(size_t rounds, size_t max_length);
+#endif
+
+#endif /* _INTERLACE_H */
@@ -0,0 +1,52 @@
+#ifndef _INVARIANT_H
+#define _INVARIANT_H
+
+#include "gauss.h"
+
+// #define TEST_INVARIANTS
+
+// invariants of a diagram which are cheap to work out, and which moves
+// only change in known ways, so they give a lower bound on how many moves
+// it takes to get from one diagram to another
+// R1 changes the crossings by one (and the writhe with them), R2 by two
+// (leaving the writhe alone, and changing the genus by at most one), and
+// R3 neither, while the index polynomial doesn't change under any of them
+typedef struct invariants_t {
+    size_t crossings;
+    // a hash of the affine index polynomial (for flat knots, the same with
+    // the crossing signs taken out), so different hashes are different
+    // polynomials
+    uint64_t index;
+    // chords which interlace an odd number of others, which only R2 moves
+    // change, by two at most
+    size_t odd;
+#ifndef FLAT_KNOTS
+    int writhe;
+    int genus;
+#endif
+} invariants_t;
+
+// more moves than any two diagrams with different index polynomials could
+// be apart
+#define INVARIANTS_FAR  ((size_t) -1)
+
+invariants_t code_invariants(const code_elem_t* code, size_t length);
+invariants_t code_invariants(const code_t& code);
+
+// the fewest moves it could take to get from a to b, or INVARIANTS_FAR if
+// no moves could
+size_t invariants_distance(const invariants_t& a, const invariants_t& b);
+
+// if a and b can't be within moves moves of each other
+static inline bool invariants_apart(const invariants_t& a, const invariants_t& b, size_t moves)
+{
+    return invariants_distance(a, b) > moves;
+}
+
+#ifdef TEST_INVARIANTS
+// check that every neighbor of a code is within a move of it going by
+// invariants, on random codes of up to max_length chords
+bool test_invariants(size_t rounds, size_t max_length);
+#endif
+
+#endif /* _INVARIANT_H */
@@ -0,0 +1,26 @@
+#ifndef _LOAD_H
+#define _LOAD_H
+
+#include "gauss.h"
+#include <string>
+#include <vector>
+
+// a line of a code file that couldn't be loaded
+typedef struct load_error_t {
+    // line number, from 1
+    size_t line;
+    // offset of the bad character (or the start of the line) in the file
+    size_t offset;
+    const char* reason;
+} load_error_t;
+
+// loads every code in a file with one code per line into codes, already
+// renumbered and ordered, splitting the file up between threads if
+// parallel is set
+// blank lines are skipped, and bad lines are reported in errors (which,
+// like codes, is cleared first)
+// returns false if the file couldn't be read at all
+bool load_codes(const std::string& path, code_list_t& codes,
+                std::vector<load_error_t>& errors, bool parallel);
+
+#endif /* _LOAD_H */
@@ -0,0 +1,38 @@
+#ifndef _MEMO_H
+#define _MEMO_H
+
+#include "gauss.h"
+
+// a bounded cache of what's been worked out about codes, keyed by their
+// first ordered code, which planar_knot looks in first for flat knots,
+// where it holds if the code is planar (as that's costly to work out
+// there, while the classical genus is cheaper than the key)
+// it's split into shards, each a table of slots behind its own lock, and a
+// code only ever goes in one of the few slots its hash picks, pushing out
+// what was there if they're full, so it never grows past its limit
+// safe to use from several threads at once
+
+typedef struct memo_stats_t {
+    size_t hits;
+    size_t misses;
+    // slots holding something, and how many there are
+    size_t used;
+    size_t slots;
+} memo_stats_t;
+
+// drop everything, and make room for about entries codes (0 turns the
+// cache off)
+void memo_limit(size_t entries);
+
+// look for the value of a first ordered code, counting a hit or a miss
+bool memo_find(const packed_code_t& code, int& value);
+void memo_insert(const packed_code_t& code, int value);
+
+// the key for a code, if it's small enough to have one and the cache is
+// on, so it's not worth looking for
+bool memo_key(const code_elem_t* code, size_t length, packed_code_t& key);
+
+memo_stats_t memo_stats();
+void memo_reset_stats();
+
+#endif /* _MEMO_H */
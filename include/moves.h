@@ -2,6 +2,10 @@
 #define _MOVES_H
 
 #include "gauss.h"
+#include "genus.h"
+#include <utility>
+
+// #define TEST_MOVES
 
 std::vector<code_t> r1_undo_enumerate(const code_t& code);
 std::vector<code_t> r1_do_enumerate(const code_t& code);
@@ -9,6 +13,14 @@ std::vector<code_t> r2_undo_enumerate(const code_t& code);
 std::vector<code_t> r2_do_enumerate(const code_t& code);
 std::vector<code_t> r3_enumerate(const code_t& code);
 
+// the same, but without renumbering or ordering the results, which can be
+// done in bulk with canonicalize_codes
+std::vector<code_t> r1_undo_unsan_enumerate(const code_t& code);
+std::vector<code_t> r1_do_unsan_enumerate(const code_t& code);
+std::vector<code_t> r2_undo_unsan_enumerate(const code_t& code);
+std::vector<code_t> r2_do_unsan_enumerate(const code_t& code);
+std::vector<code_t> r3_unsan_enumerate(const code_t& code);
+
 // enumerate neighbors of code
 std::vector<code_t> enumerate_complete_neighbors(const code_t& code);
 
@@ -19,6 +31,139 @@ std::vector<code_t> enumerate_special_neighbors(const code_t& code);
 // enumerates neighbors not enumerated by rest
 std::vector<code_t> enumerate_nonspecial_neighbors(const code_t& code);
 
+// flat versions of the above, which put the neighbors onto the end of
+// neighbors, and don't allocate once it (and their own scratch space) has
+// grown big enough
+// big codes have their moves split up between threads (unless already on
+// one of several), which gives the same neighbors in the same order
+void enumerate_complete_neighbors(const code_elem_t* code, size_t length, code_list_t& neighbors);
+void enumerate_special_neighbors(const code_elem_t* code, size_t length, code_list_t& neighbors);
+void enumerate_nonspecial_neighbors(const code_elem_t* code, size_t length, code_list_t& neighbors);
+
+#ifndef FLAT_KNOTS
+// the same, but with the genus of each neighbor put onto the end of genera
+// (which goes along with neighbors), worked out from the faces of code and
+// what each move changes, instead of going around every neighbor's faces
+void enumerate_complete_neighbors(const code_elem_t* code, size_t length, code_list_t& neighbors,
+                                  std::vector<int>& genera);
+void enumerate_special_neighbors(const code_elem_t* code, size_t length, code_list_t& neighbors,
+                                 std::vector<int>& genera);
+void enumerate_nonspecial_neighbors(const code_elem_t* code, size_t length, code_list_t& neighbors,
+                                    std::vector<int>& genera);
+
+// enumerate only the neighbors of code which are planar onto the end of
+// neighbors, in the same order as the rest, going by the faces of code to
+// skip building the R2 moves which would make virtual ones
+// (a planar code's R1, R2 do and R3 neighbors are all planar, but its R2
+// undo ones only are if both strands go along the same face)
+void enumerate_planar_neighbors(const code_elem_t* code, size_t length, code_list_t& neighbors);
+std::vector<code_t> enumerate_planar_neighbors(const code_t& code);
+
+#ifdef TEST_GENUS
+// check the genus worked out for every neighbor against going around its
+// faces, on random codes of up to max_length chords
+bool test_neighbor_genus(size_t rounds, size_t max_length);
+#endif
+#endif
+
+// enumerate neighbors of every code in codes onto the end of neighbors,
+// where the neighbors of code i end up from firsts[i] up to firsts[i + 1]
+void enumerate_complete_neighbors(const code_list_t& codes, code_list_t& neighbors,
+                                  std::vector<size_t>& firsts);
+
+#ifdef TEST_MOVES
+// check the enumerators against the slow ways of doing the same, on random
+// codes of up to max_length chords
+bool test_moves(size_t rounds, size_t max_length);
+#endif
+
+// the moves themselves, which can be gone through without building the
+// neighbors they make, and only building the ones that are needed
+#define MOVE_R1_DO          (1 << 0)
+#define MOVE_R1_UNDO        (1 << 1)
+#define MOVE_R2_DO          (1 << 2)
+#define MOVE_R2_UNDO        (1 << 3)
+#define MOVE_R3             (1 << 4)
+#define MOVE_TYPES          5
+
+#define MOVES_SPECIAL       (MOVE_R1_DO | MOVE_R2_DO | MOVE_R3)
+#define MOVES_NONSPECIAL    (MOVE_R1_UNDO | MOVE_R2_UNDO)
+#define MOVES_COMPLETE      (MOVES_SPECIAL | MOVES_NONSPECIAL)
+
+typedef struct move_t {
+    int type;
+    // positions of the move: x for R1, x and y for R2, x, y and z for R3
+    uint32_t x, y, z;
+    // for undo moves, which of the sign, over/under and flip choices
+    // it makes, a bit each in that order
+    uint8_t flags;
+} move_t;
+
+// where the other end of every element of a code is, worked out once and
+// shared by every kind of move on it, so R2 and R3 moves only look where
+// the chords can put them instead of trying every place, along with the
+// smallest rotation taking the code to itself, for undo moves
+typedef struct ends_t {
+    std::vector<size_t> partner;
+    size_t period;
+} ends_t;
+
+typedef struct move_iter_t {
+    const code_elem_t* code;
+    size_t length;
+    int types;
+
+    // index of the type being gone through, and where it's got to
+    int type;
+    bool started;
+    move_t move;
+
+    ends_t ends;
+    // for R2 and R3 moves, the places to try for the current x, as how far
+    // on from it y (and z) are
+    std::pair<size_t, size_t> candidates[8];
+    size_t candidate, candidate_count;
+} move_iter_t;
+
+// go through the moves of the given types on code, which has to stay
+// around until it's done, in the same order the enumerators above give
+// their neighbors
+void move_iter_start(move_iter_t& iter, const code_elem_t* code, size_t length, int types = MOVES_COMPLETE);
+bool move_iter_next(move_iter_t& iter, move_t& move);
+
+// the length of the code after a move of this type
+size_t move_length(size_t length, int type);
+
+// write the code after the move into moved (which needs room for
+// move_length elements), without renumbering or ordering it, or with for
+// move_neighbor
+void move_apply(const code_elem_t* code, size_t length, const move_t& move, code_elem_t* moved);
+void move_neighbor(const code_elem_t* code, size_t length, const move_t& move, code_elem_t* out);
+
+// find a move (of the given types) from code to target, which has to be
+// renumbered and ordered, stopping at the first and only building the
+// neighbors which are the same length as target
+bool find_move(const code_elem_t* code, size_t length, const code_elem_t* target, size_t target_length,
+               move_t& move, int types = MOVES_COMPLETE);
+
+// undo moves can be put in at many places that make the same diagram, so
+// the ones which can be seen to be the same as one before them by where
+// they go (next to a chord just like them, or at places the code can be
+// rotated between) are never built
+// the few left over are only taken out by r1_undo_enumerate and
+// r2_undo_enumerate, which give each diagram once, as it costs about as
+// much as the lookups the search does on every neighbor anyway
+typedef struct move_stats_t {
+    // undo moves there are to try, how many were never built, and how many
+    // were only taken out once built
+    size_t candidates;
+    size_t avoided;
+    size_t dropped;
+} move_stats_t;
+
+move_stats_t move_stats();
+void move_reset_stats();
+
 // enumerate neighbors of code (unsan)
 std::vector<code_t> enumerate_complete_unsan_neighbors(const code_t& code);
 
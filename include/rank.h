@@ -0,0 +1,39 @@
+#ifndef _RANK_H
+#define _RANK_H
+
+#include "gauss.h"
+#include <vector>
+
+// #define TEST_RANK
+
+// a numbering of every first ordered code with a given number of chords by
+// 0 up to the number of them, so that explorations over small diagrams can
+// keep nodes, flags and visited sets in plain arrays and bitmaps instead of
+// hashing codes
+// the table is just the codes in increasing order, so a code's rank is its
+// position in it
+
+#define RANK_NONE   ((size_t) -1)
+
+typedef struct rank_table_t {
+    size_t chords;
+    std::vector<packed_code_t> codes;
+} rank_table_t;
+
+// fill the table with every code with chords chords, from a census
+void rank_table_build(rank_table_t& table, size_t chords);
+
+size_t rank_table_size(const rank_table_t& table);
+
+// the rank of a first ordered code, or RANK_NONE if it isn't in the table
+size_t rank_code(const rank_table_t& table, const packed_code_t& code);
+
+// the code with a given rank
+packed_code_t unrank_code(const rank_table_t& table, size_t rank);
+
+#ifdef TEST_RANK
+// check that rank and unrank undo each other for every code in the table
+bool test_rank(const rank_table_t& table);
+#endif
+
+#endif /* _RANK_H */
@@ -0,0 +1,43 @@
+#ifndef _SAMPLE_H
+#define _SAMPLE_H
+
+#include "gauss.h"
+#include <functional>
+#include <ostream>
+
+// which diagrams to keep
+enum sample_filter_t {
+    SAMPLE_ANY, SAMPLE_PLANAR, SAMPLE_VIRTUAL
+};
+
+typedef struct sample_options_t {
+    // how many to sample, and how many chords each has
+    size_t count;
+    size_t chords;
+    // the same seed gives the same samples, however many threads there are
+    uint64_t seed;
+    // only give back each diagram once
+    bool dedupe;
+    sample_filter_t filter;
+#ifndef FLAT_KNOTS
+    // only keep diagrams of this genus, if not negative
+    int genus;
+#endif
+    // give up after this many tries, if not zero
+    size_t max_tries;
+} sample_options_t;
+
+// sensible defaults: no filter, no dedupe
+sample_options_t sample_defaults(size_t count, size_t chords, uint64_t seed);
+
+// samples random canonical codes across threads, handing them to callback
+// (always from the calling thread, in the same order for the same options)
+// returns how many were handed out, which is less than asked only if it
+// gave up
+size_t sample_codes(const sample_options_t& options,
+                    const std::function<void(const code_t&)>& callback);
+
+// the same, writing them out a line each
+size_t sample_codes(const sample_options_t& options, std::ostream& out);
+
+#endif /* _SAMPLE_H */
@@ -2,12 +2,18 @@
 #define _SUBDIAG_H
 
 #include "gauss.h"
+#include "hash.h"
 #include <unordered_set>
 
 // initialize the a list of subsets
 void subsets_init();
 
 // get subdiagrams of a code
-std::unordered_set<code_t> subdiagrams(const code_t& code);
+std::unordered_set<packed_code_t> subdiagrams(const code_t& code);
+
+// get subdiagrams of a code which could be planar: ones where every chord
+// interlaces an even number of the others, which every planar one does,
+// so the rest can be left out without building them
+std::unordered_set<packed_code_t> even_subdiagrams(const code_t& code);
 
 #endif /* _SUBDIAG_H */
@@ -3,11 +3,31 @@
 
 #include "gauss.h"
 
+// #define TEST_PLANAR
+
 // takes in a gauss code and returns true if it's planar/classical
-// the cubic version
-bool planar_knot_cubic(const code_t& input_code);
+// the cubic version, which works for flat knots too
+// safe to call from several threads at once
+bool planar_knot_cubic(const code_elem_t* code, size_t length);
+bool planar_knot_cubic(const code_t& code);
 
 // takes in a gauss code and returns true if it's planar/classical
+// for flat knots the result is remembered in the cache (see memo.h)
+bool planar_knot(const code_elem_t* code, size_t length);
 bool planar_knot(const code_t& code);
 
+// set bit i of planar (a word for every 64 codes) if code i is planar, for
+// count codes of length elements stored back to back, going across several
+// codes at once where it can
+void planar_knots(const code_elem_t* codes, size_t count, size_t length, uint64_t* planar);
+
+// the same for every code in a list, which can be of different lengths
+void planar_knots(const code_list_t& codes, std::vector<uint64_t>& planar);
+
+#ifdef TEST_PLANAR
+// check planar_knot_cubic against the version with sets, on random codes of
+// up to max_length chords
+bool test_planar(size_t rounds, size_t max_length);
+#endif
+
 #endif /* _VIRTUAL_H */
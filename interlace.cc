@@ -0,0 +1,129 @@
+#include <algorithm>
+#include "gauss.h"
+#include "interlace.h"
+#include "invariant.h"
+#include <iostream>
+#include <vector>
+
+// the chords open just after a position are those with one end at or
+// before it, and one after it
+// a chord interlaces the ones whose membership changes between its ends,
+// so its row is the open chords when it opens XOR the open chords when it
+// closes (where it's in both, cancelling itself out)
+void interlace_build(interlace_t& m, const code_elem_t* code, size_t length)
+{
+    static thread_local std::vector<uint64_t> open;
+
+    size_t ids = 0;
+    for (size_t i = 0; i < length; i++) {
+        ids = std::max(ids, (size_t) ELEM_ID(code[i]) + 1);
+    }
+
+    m.ids = ids; m.words = (ids + 63) / 64; m.length = length;
+    m.rows.assign(ids * m.words, 0);
+    m.ends.assign(2 * ids, INTERLACE_NONE);
+    m.at.resize(length);
+    open.assign(m.words, 0);
+
+    for (size_t i = 0; i < length; i++) {
+        size_t id = ELEM_ID(code[i]);
+        m.at[i] = id;
+        open[id / 64] ^= 1ull << (id % 64);
+
+        uint64_t* row = &m.rows[id * m.words];
+        for (size_t w = 0; w < m.words; w++) {
+            row[w] ^= open[w];
+        }
+
+        if (m.ends[2 * id] == INTERLACE_NONE) {
+            m.ends[2 * id] = i;
+        } else {
+            m.ends[2 * id + 1] = i;
+            // it's closed, so it's not in the open chords which were xored
+            // in, but it was when it opened
+            row[id / 64] ^= 1ull << (id % 64);
+        }
+    }
+}
+
+size_t interlace_degree(const interlace_t& m, size_t id)
+{
+    const uint64_t* row = interlace_row(m, id);
+
+    size_t degree = 0;
+    for (size_t w = 0; w < m.words; w++) {
+        degree += __builtin_popcountll(row[w]);
+    }
+
+    return degree;
+}
+
+size_t interlace_odd_chords(const interlace_t& m)
+{
+    size_t odd = 0;
+    for (size_t id = 0; id < m.ids; id++) {
+        odd += interlace_degree(m, id) & 1;
+    }
+
+    return odd;
+}
+
+// if every chord in the set interlaces an even number of the others in it
+bool interlace_even(const interlace_t& m, const uint64_t* set)
+{
+    for (size_t w = 0; w < m.words; w++) {
+        for (uint64_t bits = set[w]; bits; bits &= bits - 1) {
+            const uint64_t* row = interlace_row(m, 64 * w + __builtin_ctzll(bits));
+
+            size_t degree = 0;
+            for (size_t v = 0; v < m.words; v++) {
+                degree += __builtin_popcountll(row[v] & set[v]);
+            }
+
+            if (degree & 1) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+#ifdef TEST_INTERLACE
+// check the matrix of random codes of up to max_length chords against
+// looking at the ends of every pair of chords
+bool test_interlace(size_t rounds, size_t max_length)
+{
+    interlace_t m;
+    for (size_t i = 0; i < rounds; i++) {
+        code_t code = random_code(rand() % max_length + 1);
+        interlace_build(m, code.data(), code.size());
+
+        size_t length = code.size();
+        bool ok = m.length == length;
+        for (size_t p = 0; p < length && ok; p++) {
+            size_t a = ELEM_ID(code[p]), p_ = interlace_partner(m, p);
+            ok = m.at[p] == a && p_ != p && ELEM_ID(code[p_]) == a;
+
+            for (size_t q = 0; q < length && ok; q++) {
+                size_t b = ELEM_ID(code[q]), q_ = interlace_partner(m, q);
+                if (a == b) {
+                    continue;
+                }
+
+                // b interlaces a if exactly one of its ends is between a's
+                bool first = (q > std::min(p, p_)) && (q < std::max(p, p_));
+                bool second = (q_ > std::min(p, p_)) && (q_ < std::max(p, p_));
+                ok = interlaced(m, a, b) == (first != second);
+            }
+        }
+
+        if (!ok || interlace_odd_chords(m) != code_invariants(code).odd) {
+            std::cout << "Interlacement of " << stringify_code(code) << " doesn't match" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+#endif
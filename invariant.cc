@@ -0,0 +1,149 @@
+#include <algorithm>
+#include "gauss.h"
+#include "genus.h"
+#include "hash.h"
+#include "invariant.h"
+#include <iostream>
+#include "moves.h"
+#include <vector>
+
+// what an element adds to the index of a chord whose arc it's on: its
+// sign, taken away for U (for flat knots, whether it's + or -)
+static inline int index_weight(code_elem_t elem)
+{
+#ifndef FLAT_KNOTS
+    return (elem & ELEM_OVER) ? SIGN(elem) : -SIGN(elem);
+#else
+    return SIGN(elem);
+#endif
+}
+
+// if the element is the end of its chord the arc starts from
+static inline bool arc_start(code_elem_t elem)
+{
+#ifndef FLAT_KNOTS
+    return elem & ELEM_OVER;
+#else
+    return elem & ELEM_POSITIVE;
+#endif
+}
+
+// a term t^w of the index polynomial, hashed
+static inline uint64_t index_term(int w)
+{
+    return hash_mum((uint64_t) (int64_t) w ^ hash_secret[0], hash_secret[1]);
+}
+
+invariants_t code_invariants(const code_elem_t* code, size_t length)
+{
+    static const size_t none = -1;
+    static thread_local std::vector<int> before;
+    static thread_local std::vector<size_t> start;
+
+    invariants_t invariants;
+    invariants.crossings = length / 2;
+    invariants.index = 0;
+    invariants.odd = 0;
+
+    // the sum of the weights before each position, which add up to 0 over
+    // the whole code (each chord's two ends cancel), so the sum over the
+    // arc from a to b going round is before[b] - before[a + 1] either way
+    before.resize(length + 1);
+    before[0] = 0;
+    for (size_t i = 0; i < length; i++) {
+        before[i + 1] = before[i] + index_weight(code[i]);
+    }
+
+    code_elem_t max = 0;
+    for (size_t i = 0; i < length; i++) {
+        max = std::max(max, ELEM_ID(code[i]));
+    }
+    start.assign(length ? max + 1 : 0, none);
+    for (size_t i = 0; i < length; i++) {
+        if (arc_start(code[i])) {
+            start[ELEM_ID(code[i])] = i;
+        }
+    }
+
+#ifndef FLAT_KNOTS
+    invariants.writhe = 0;
+#endif
+    for (size_t i = 0; i < length; i++) {
+        if (arc_start(code[i])) {
+            continue;
+        }
+
+        // the index of the chord, from its start going round to here, and
+        // its term sign * (t^w - 1)
+        int w = before[i] - before[start[ELEM_ID(code[i])] + 1];
+        // every chord it interlaces adds one to the index or takes one
+        // away, and the others add nothing
+        invariants.odd += w & 1;
+#ifndef FLAT_KNOTS
+        invariants.writhe += SIGN(code[i]);
+        invariants.index += SIGN(code[i]) * (index_term(w) - index_term(0));
+#else
+        invariants.index += index_term(w) - index_term(-w);
+#endif
+    }
+
+#ifndef FLAT_KNOTS
+    invariants.genus = genus(code, length);
+#endif
+
+    return invariants;
+}
+
+invariants_t code_invariants(const code_t& code)
+{
+    return code_invariants(code.data(), code.size());
+}
+
+static size_t difference(ssize_t a, ssize_t b)
+{
+    return (a > b) ? a - b : b - a;
+}
+
+// the fewest moves it could take to get from a to b
+size_t invariants_distance(const invariants_t& a, const invariants_t& b)
+{
+    if (a.index != b.index) {
+        return INVARIANTS_FAR;
+    }
+
+    size_t crossings = difference(a.crossings, b.crossings);
+    size_t odd = difference(a.odd, b.odd) / 2;
+#ifndef FLAT_KNOTS
+    // every R1 move changes the writhe by one, and the crossings left over
+    // take a R2 move for every two, as does every change in genus and every
+    // two odd chords
+    size_t r1 = difference(a.writhe, b.writhe);
+    size_t r2 = std::max((crossings > r1) ? (crossings - r1 + 1) / 2 : 0,
+                         std::max((size_t) difference(a.genus, b.genus), odd));
+    return r1 + r2;
+#else
+    return std::max((crossings + 1) / 2, odd);
+#endif
+}
+
+#ifdef TEST_INVARIANTS
+// check that every neighbor of a code is within a move of it going by
+// invariants, on random codes of up to max_length chords
+bool test_invariants(size_t rounds, size_t max_length)
+{
+    for (size_t i = 0; i < rounds; i++) {
+        code_t code = random_code(rand() % max_length);
+        invariants_t invariants = code_invariants(code);
+
+        for (auto& neighbor: enumerate_complete_neighbors(code)) {
+            if (invariants_distance(invariants, code_invariants(neighbor)) > 1) {
+                std::cout << "Neighbor " << stringify_code(neighbor) << " of " << stringify_code(code)
+                          << " is too far going by invariants" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+#endif
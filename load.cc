@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fcntl.h>
+#include "gauss.h"
+#include "load.h"
+#include <omp.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// what one thread loaded out of its share of the file
+typedef struct load_chunk_t {
+    code_list_t codes;
+    std::vector<load_error_t> errors;
+    size_t lines;
+} load_chunk_t;
+
+// check both ends of every chord of a renumbered code agree with each other:
+// an over and an under with the same sign, or (for flat knots) one of
+// each sign
+static bool matched_code(const code_elem_t* code, size_t length, std::vector<code_elem_t>& first)
+{
+    // no flags fill every bit, so this can't be mistaken for any
+    static const code_elem_t unseen = (code_elem_t) -1;
+
+    first.assign(length / 2, unseen);
+    for (size_t i = 0; i < length; i++) {
+        code_elem_t id = ELEM_ID(code[i]), flags = code[i] & ELEM_FLAGS_MASK;
+        if (first[id] == unseen) {
+            first[id] = flags;
+            continue;
+        }
+
+#ifdef FLAT_KNOTS
+        if (first[id] == flags) {
+            return false;
+        }
+#else
+        if ((first[id] ^ flags) != ELEM_OU_MASK) {
+            return false;
+        }
+#endif
+    }
+
+    return true;
+}
+
+// load the lines in [begin, end), which starts at the beginning of a line
+// line numbers in errors are relative to the start of the chunk
+static void load_chunk(const char* file, const char* begin, const char* end, load_chunk_t& chunk)
+{
+    // raw elements of the current line, grown to the longest line seen
+    std::vector<code_elem_t> raw, matched;
+    chunk.lines = 0;
+
+    const char* line = begin;
+    while (line < end) {
+        const char* eol = (const char*) memchr(line, '\n', end - line);
+        if (!eol) eol = end;
+        chunk.lines++;
+
+        size_t half = (eol - line) / 2, length;
+        if (raw.size() < half) {
+            raw.resize(half);
+        }
+
+        const char* bad = scan_code(line, eol, raw.data(), &length);
+        if (bad) {
+            load_error_t e = { chunk.lines, (size_t) (bad - file), "bad element" };
+            chunk.errors.push_back(e);
+        } else if (length) {
+            // canonicalize straight into the output
+            size_t start = chunk.codes.elems.size();
+            chunk.codes.elems.resize(start + length);
+            const char* reason = NULL;
+            if (!canonicalize_code(raw.data(), length, &chunk.codes.elems[start])) {
+                reason = "not a chord diagram";
+            } else if (!matched_code(&chunk.codes.elems[start], length, matched)) {
+                reason = "crossing ends don't match";
+            }
+
+            if (!reason) {
+                chunk.codes.offsets.push_back(chunk.codes.elems.size());
+            } else {
+                chunk.codes.elems.resize(start);
+                load_error_t e = { chunk.lines, (size_t) (line - file), reason };
+                chunk.errors.push_back(e);
+            }
+        }
+
+        line = eol + 1;
+    }
+}
+
+// loads every code in a file with one code per line into codes, already
+// renumbered and ordered, splitting the file up between threads if
+// parallel is set
+// blank lines are skipped, and bad lines are reported in errors (which,
+// like codes, is cleared first)
+// returns false if the file couldn't be read at all
+bool load_codes(const std::string& path, code_list_t& codes,
+                std::vector<load_error_t>& errors, bool parallel)
+{
+    code_list_clear(codes);
+    errors.clear();
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    if (!size) {
+        close(fd);
+        return true;
+    }
+
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    const char* file = (const char*) map, *file_end = file + size;
+    size_t parts = parallel ? omp_get_max_threads() : 1;
+    std::vector<load_chunk_t> chunks(parts);
+
+    // split at the first newline after every equal share of the file
+    std::vector<const char*> bounds(parts + 1, file_end);
+    bounds[0] = file;
+    for (size_t i = 1; i < parts; i++) {
+        const char* split = std::max(file + size * i / parts, bounds[i - 1]);
+        const char* eol = (const char*) memchr(split, '\n', file_end - split);
+        bounds[i] = eol ? eol + 1 : file_end;
+    }
+
+    #pragma omp parallel for schedule(static, 1) if (parts > 1)
+    for (size_t i = 0; i < parts; i++) {
+        load_chunk(file, bounds[i], bounds[i + 1], chunks[i]);
+    }
+
+    // stitch the chunks back together in order
+    size_t lines = 0;
+    for (auto& chunk: chunks) {
+        size_t base = codes.elems.size();
+        codes.elems.insert(codes.elems.end(), chunk.codes.elems.begin(), chunk.codes.elems.end());
+        for (size_t i = 1; i < chunk.codes.offsets.size(); i++) {
+            codes.offsets.push_back(base + chunk.codes.offsets[i]);
+        }
+
+        for (auto e: chunk.errors) {
+            e.line += lines;
+            errors.push_back(e);
+        }
+        lines += chunk.lines;
+    }
+
+    munmap(map, size);
+    return true;
+}
@@ -1,18 +1,101 @@
 #include <algorithm>
 #include <cassert>
+#include "bench.h"
+#include "census.h"
+#include "codeset.h"
 #include <cstdlib>
 #include <ctime>
 #include "genus.h"
 #include "graph.h"
 #include "gauss.h"
+#include "interlace.h"
+#include "invariant.h"
 #include <iostream>
+#include "load.h"
 #include "moves.h"
+#include "rank.h"
+#include "sample.h"
 #include "subdiag.h"
 #include <vector>
 #include "virtual.h"
 
 int main(int argc, char const *argv[])
 {
+    if (argc > 2 && std::string(argv[1]) == "-f") {
+        // load a file of codes, and print them ordered
+        code_list_t codes; std::vector<load_error_t> errors;
+        if (!load_codes(argv[2], codes, errors, true)) {
+            std::cerr << "Can't read " << argv[2] << std::endl;
+            return 1;
+        }
+
+        for (auto& e: errors) {
+            std::cerr << argv[2] << ":" << e.line << ": " << e.reason
+                      << " at offset " << e.offset << std::endl;
+        }
+
+        std::cerr << "Loaded " << code_list_size(codes) << " codes, "
+                  << errors.size() << " bad lines" << std::endl;
+
+        if (argc > 4 && std::string(argv[3]) == "-w") {
+            // store them as a code set instead
+            std::vector<packed_code_t> packed;
+            for (size_t i = 0; i < code_list_size(codes); i++) {
+                // too big to pack, so it can't go in a code set
+                if (code_list_length(codes, i) > 2 * PACKED_MAX_CHORDS) {
+                    std::cerr << "Skipping code " << i << ", which has " << code_list_length(codes, i) / 2
+                              << " chords (at most " << PACKED_MAX_CHORDS << " fit)" << std::endl;
+                    continue;
+                }
+                packed.push_back(pack_code(code_list_elems(codes, i), code_list_length(codes, i)));
+            }
+
+            if (!write_codeset(argv[4], packed)) {
+                std::cerr << "Can't write " << argv[4] << std::endl;
+                return 1;
+            }
+            return 0;
+        }
+
+        for (size_t i = 0; i < code_list_size(codes); i++) {
+            display_code(code_list_get(codes, i));
+        }
+        return 0;
+    }
+
+    if (argc > 3 && std::string(argv[1]) == "-s") {
+        // sample random diagrams
+        uint64_t seed = (argc > 4) ? std::stoull(argv[4]) : time(NULL);
+        sample_options_t options = sample_defaults(std::stoul(argv[3]), std::stoul(argv[2]), seed);
+        sample_codes(options, std::cout);
+        return 0;
+    }
+
+    if (argc > 2 && std::string(argv[1]) == "-b") {
+        // how long things take on bigger and bigger diagrams
+        uint64_t seed = (argc > 3) ? std::stoull(argv[3]) : time(NULL);
+        bench_scaling(std::stoul(argv[2]), seed, std::cout);
+        return 0;
+    }
+
+    if (argc > 2 && std::string(argv[1]) == "-c") {
+        // every diagram with this many chords, picking up after the last
+        // one given if any
+        size_t chords = std::stoul(argv[2]);
+        census_t census;
+        if (argc > 3) {
+            census_resume(census, chords, code_t(), parse_code(argv[3]));
+        } else {
+            census_start(census, chords);
+        }
+
+        code_t code;
+        while (census_next(census, code)) {
+            display_code(code);
+        }
+        return 0;
+    }
+
     if (argc > 1) {
         code_t code = parse_code(std::string(argv[1]));
 
@@ -67,14 +150,25 @@ int main(int argc, char const *argv[])
         }
 
         std::cout << "All planar neighbors" << std::endl;
-        list = enumerate_complete_neighbors(code);
+#ifdef FLAT_KNOTS
+        code_list_t neighbors; std::vector<uint64_t> planar;
+        enumerate_complete_neighbors(code.data(), code.size(), neighbors);
+        planar_knots(neighbors, planar);
+
+        list.clear();
+        for (size_t i = 0; i < code_list_size(neighbors); i++) {
+            if ((planar[i / 64] >> (i % 64)) & 1) {
+                list.push_back(code_list_get(neighbors, i));
+            }
+        }
+#else
+        list = enumerate_planar_neighbors(code);
+#endif
 
         std::sort(list.begin(), list.end());
         list.erase(std::unique(list.begin(), list.end()), list.end());
         for (size_t i = 0; i < list.size(); i++) {
-            if (planar_knot(list[i])) {
-                display_code(list[i]);
-            }
+            display_code(list[i]);
         }
 
         // subdiagrams(code);
@@ -83,6 +177,66 @@ int main(int argc, char const *argv[])
     srand(time(NULL));
     subsets_init();
 
+#ifdef TEST_CANONICAL
+    std::cout << "Testing canonical codes" << std::endl;
+    if (!test_canonical(100000, MAX_CHORDS)) {
+        return 1;
+    }
+    std::cout << "Finished canonical test" << std::endl;
+#endif
+
+#if defined(TEST_GENUS) && !defined(FLAT_KNOTS)
+    std::cout << "Testing genus" << std::endl;
+    if (!test_genus(100000, MAX_CHORDS) || !test_neighbor_genus(1000, MAX_CHORDS - 2)) {
+        return 1;
+    }
+    std::cout << "Finished genus test" << std::endl;
+#endif
+
+#ifdef TEST_PLANAR
+    std::cout << "Testing planarity" << std::endl;
+    if (!test_planar(100000, MAX_CHORDS)) {
+        return 1;
+    }
+    std::cout << "Finished planarity test" << std::endl;
+#endif
+
+#ifdef TEST_MOVES
+    std::cout << "Testing moves" << std::endl;
+    if (!test_moves(100000, MAX_CHORDS)) {
+        return 1;
+    }
+    std::cout << "Finished moves test" << std::endl;
+#endif
+
+#ifdef TEST_INTERLACE
+    std::cout << "Testing interlacement" << std::endl;
+    if (!test_interlace(10000, MAX_CHORDS)) {
+        return 1;
+    }
+    std::cout << "Finished interlacement test" << std::endl;
+#endif
+
+#ifdef TEST_INVARIANTS
+    std::cout << "Testing invariants" << std::endl;
+    if (!test_invariants(1000, MAX_CHORDS - 2)) {
+        return 1;
+    }
+    std::cout << "Finished invariants test" << std::endl;
+#endif
+
+#ifdef TEST_RANK
+    for (size_t chords = 0; chords <= 5; chords++) {
+        rank_table_t table; rank_table_build(table, chords);
+        std::cout << "Testing ranks of " << rank_table_size(table) << " codes with "
+                  << chords << " chords" << std::endl;
+        if (!test_rank(table)) {
+            return 1;
+        }
+    }
+    std::cout << "Finished rank test" << std::endl;
+#endif
+
 #if 0
     std::vector<std::string> movie;
     movie.push_back("U-0U-1O-2O+3U+3U-2U+4O+5O-1O+4U+5O+6U+6O-0");
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <atomic>
+#include "gauss.h"
+#include "hash.h"
+#include "memo.h"
+#include <mutex>
+#include <vector>
+
+// codes the cache holds by default
+#define MEMO_DEFAULT_ENTRIES    (1 << 18)
+#define MEMO_SHARDS             64
+// slots a code can go in
+#define MEMO_WAYS               4
+
+typedef struct memo_slot_t {
+    packed_code_t code;
+    int value;
+    bool used;
+} memo_slot_t;
+
+typedef struct memo_shard_t {
+    std::mutex lock;
+    std::vector<memo_slot_t> slots;
+    size_t used;
+    // which slot of a full bucket to push out next
+    size_t victim;
+} memo_shard_t;
+
+static memo_shard_t shards[MEMO_SHARDS];
+static std::once_flag shards_made;
+static std::atomic<size_t> hits(0), misses(0);
+static std::atomic<bool> enabled(true);
+
+static void memo_resize(size_t entries)
+{
+    size_t per_shard = (entries + MEMO_SHARDS * MEMO_WAYS - 1) / (MEMO_SHARDS * MEMO_WAYS) * MEMO_WAYS;
+    for (auto& shard: shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        shard.slots.assign(per_shard, memo_slot_t());
+        shard.used = 0; shard.victim = 0;
+    }
+
+    enabled = per_shard > 0;
+}
+
+static void memo_init()
+{
+    std::call_once(shards_made, memo_resize, (size_t) MEMO_DEFAULT_ENTRIES);
+}
+
+// drop everything, and make room for about entries codes
+void memo_limit(size_t entries)
+{
+    memo_init();
+    memo_resize(entries);
+}
+
+// the shard a code goes in picks off the top of the hash, and its bucket
+// of MEMO_WAYS slots in the shard the rest
+static memo_shard_t& memo_shard(uint64_t hash)
+{
+    return shards[hash >> 58];
+}
+
+static memo_slot_t* memo_bucket(memo_shard_t& shard, uint64_t hash)
+{
+    size_t buckets = shard.slots.size() / MEMO_WAYS;
+    return &shard.slots[(hash & ((1ull << 58) - 1)) % buckets * MEMO_WAYS];
+}
+
+// look for the value of a first ordered code, counting a hit or a miss
+bool memo_find(const packed_code_t& code, int& value)
+{
+    memo_init();
+
+    uint64_t hash = hash_code(code);
+    memo_shard_t& shard = memo_shard(hash);
+
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        if (!shard.slots.empty()) {
+            memo_slot_t* bucket = memo_bucket(shard, hash);
+            for (size_t i = 0; i < MEMO_WAYS; i++) {
+                if (bucket[i].used && bucket[i].code == code) {
+                    value = bucket[i].value;
+                    found = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    (found ? hits : misses).fetch_add(1, std::memory_order_relaxed);
+    return found;
+}
+
+void memo_insert(const packed_code_t& code, int value)
+{
+    memo_init();
+
+    uint64_t hash = hash_code(code);
+    memo_shard_t& shard = memo_shard(hash);
+
+    std::lock_guard<std::mutex> guard(shard.lock);
+    if (shard.slots.empty()) {
+        return;
+    }
+
+    // go in a free slot (or the code's own) if there is one, otherwise
+    // push out the slots in turn
+    memo_slot_t* bucket = memo_bucket(shard, hash);
+    memo_slot_t* slot = NULL;
+    for (size_t i = 0; i < MEMO_WAYS && !slot; i++) {
+        if (!bucket[i].used || bucket[i].code == code) {
+            slot = &bucket[i];
+        }
+    }
+
+    if (!slot) {
+        slot = &bucket[shard.victim++ % MEMO_WAYS];
+    } else if (!slot->used) {
+        shard.used++;
+    }
+    slot->code = code; slot->value = value; slot->used = true;
+}
+
+// the key for a code, its first ordered code packed, if it's small enough
+// and the cache is on
+bool memo_key(const code_elem_t* code, size_t length, packed_code_t& key)
+{
+    static thread_local std::vector<code_elem_t> first;
+
+    if (!enabled || length > 2 * PACKED_MAX_CHORDS) {
+        return false;
+    }
+
+    first.resize(length);
+    if (!canonicalize_code(code, length, first.data())) {
+        return false;
+    }
+
+    key = pack_code(first.data(), length);
+    return true;
+}
+
+memo_stats_t memo_stats()
+{
+    memo_init();
+
+    memo_stats_t stats;
+    stats.hits = hits.load(); stats.misses = misses.load();
+    stats.used = stats.slots = 0;
+    for (auto& shard: shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        stats.used += shard.used;
+        stats.slots += shard.slots.size();
+    }
+
+    return stats;
+}
+
+void memo_reset_stats()
+{
+    hits = 0; misses = 0;
+}
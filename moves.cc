@@ -1,4 +1,11 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include "genus.h"
+#include "hash.h"
+#include <iostream>
 #include "moves.h"
+#include <omp.h>
 #include <set>
 #include <vector>
 
@@ -13,45 +20,199 @@ void cleanup_movie(std::vector<std::string> movie)
 
     auto prev = list[0];
     for (auto cur: list) {
-        auto neighbors = enumerate_complete_unsan_neighbors(prev);
-        code_t next = code_t();
-        for (auto iter: neighbors) {
-            auto san = iter;
-
-            size_t max = 0;
-            for (auto code_iter: san) {
-                max = std::max(max, (size_t) ELEM_ID(code_iter));
-            }
-            renumber_code(san, max + 1);
-            san = first_ordered_code(san);
+        // only the move which gets to cur needs building
+        move_t move;
+        if (find_move(prev.data(), prev.size(), cur.data(), cur.size(), move)) {
+            code_t next(move_length(prev.size(), move.type));
+            move_apply(prev.data(), prev.size(), move, next.data());
+            prev = next;
+        }
+        display_code(prev);
+    }
+}
+
+// scratch space for building moved codes, reused across calls
+static thread_local std::vector<code_elem_t> scratch;
+
+// put a moved code onto the end of out, renumbered and ordered if sanitize
+// is set
+static void emit(code_list_t& out, const code_elem_t* moved, size_t length, bool sanitize)
+{
+    if (!sanitize) {
+        code_list_push(out, moved, length);
+        return;
+    }
+
+    size_t start = out.elems.size();
+    out.elems.resize(start + length);
+    canonicalize_any_code(moved, length, &out.elems[start]);
+    out.offsets.push_back(out.elems.size());
+}
+
+// how many undo moves were tried, how many of those were never built since
+// they make the same diagram as one before them, and how many more were
+// only found to once built
+static std::atomic<size_t> undo_candidates(0), undo_avoided(0), undo_dropped(0);
+
+// takes out codes in list which are the same as one before them, as undo
+// moves make a few which can't be told apart before building them (going
+// through a bigon or kink already there, or around a rotation and then by
+// a chord)
+static void drop_duplicates(code_list_t& list)
+{
+    static thread_local std::vector<uint64_t> hashes;
+    static thread_local std::vector<size_t> table;
+
+    size_t count = code_list_size(list);
+    if (count < 2) {
+        return;
+    }
 
-            if (!compare_codes(san, cur)) {
-                prev = iter;
+    // an open addressed table of the ones kept so far (plus one), by hash
+    size_t size = 1;
+    while (size < 2 * count) {
+        size <<= 1;
+    }
+    table.assign(size, 0);
+    hashes.resize(count);
+
+    // offsets are read before they're written over, since kept never gets
+    // past i
+    size_t kept = 0, start = 0, end = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t next = list.offsets[i + 1], length = next - start;
+        const code_elem_t* code = list.elems.data() + start;
+        hashes[kept] = hash_code(code, length);
+
+        size_t slot = hashes[kept] & (size - 1);
+        bool seen = false;
+        for (; table[slot]; slot = (slot + 1) & (size - 1)) {
+            size_t j = table[slot] - 1;
+            if (hashes[j] == hashes[kept] && code_list_length(list, j) == length &&
+                std::equal(code, code + length, code_list_elems(list, j))) {
+                seen = true;
                 break;
             }
         }
-        display_code(prev);
+
+        if (seen) {
+            undo_dropped++;
+        } else {
+            table[slot] = kept + 1;
+            std::copy(list.elems.begin() + start, list.elems.begin() + next, list.elems.begin() + end);
+            end += length;
+            list.offsets[++kept] = end;
+        }
+        start = next;
     }
+
+    list.elems.resize(end);
+    list.offsets.resize(kept + 1);
 }
 
-// inserts a R1 move before x
-// positive         - if the (first, for flat knots) sign is positive
-// first_over       - if first element is over
-#ifdef FLAT_KNOTS
-static code_t r1_undo_unsan(code_t code, size_t x, bool positive)
-#else
-static code_t r1_undo_unsan(code_t code, size_t x, bool positive, bool first_over)
-#endif
+// the id after the largest in code, for new chords
+static code_elem_t next_id(const code_elem_t* code, size_t length)
 {
-    code_elem_t first;
-
     ssize_t max = -1;
-    for (auto iter: code) {
-        max = std::max(max, (ssize_t) ELEM_ID(iter));
+    for (size_t i = 0; i < length; i++) {
+        max = std::max(max, (ssize_t) ELEM_ID(code[i]));
+    }
+
+    return max + 1;
+}
+
+// the position of the other end of every element
+static void load_partners(const code_elem_t* code, size_t length, std::vector<size_t>& partner)
+{
+    static const size_t none = -1;
+    static thread_local std::vector<size_t> opened;
+
+    opened.assign(next_id(code, length), none);
+    partner.resize(length);
+    for (size_t i = 0; i < length; i++) {
+        code_elem_t id = ELEM_ID(code[i]);
+        if (opened[id] == none) {
+            opened[id] = partner[i] = i;
+        } else {
+            partner[i] = opened[id]; partner[opened[id]] = i;
+        }
+    }
+}
+
+// the smallest rotation which takes code to itself (once renumbered), or
+// length if only going all the way around does, from what each position
+// looks like from the chord it's on
+static size_t code_period(const code_elem_t* code, size_t length, const size_t* partner)
+{
+    static thread_local std::vector<uint64_t> shape;
+    static thread_local std::vector<size_t> border;
+
+    if (!length) {
+        return 0;
+    }
+
+    shape.resize(length);
+    for (size_t i = 0; i < length; i++) {
+        shape[i] = ((uint64_t) ((partner[i] + length - i) % length) << ELEM_ID_SHIFT) | (code[i] & ELEM_FLAGS_MASK);
+    }
+
+    // the longest border of the shape is what's left over by its period
+    border.resize(length);
+    border[0] = 0;
+    for (size_t i = 1; i < length; i++) {
+        size_t k = border[i - 1];
+        while (k && shape[i] != shape[k]) {
+            k = border[k - 1];
+        }
+        border[i] = k + (shape[i] == shape[k]);
     }
 
-    // first = (code.size() / 2) << ELEM_ID_SHIFT;
-    first = (max + 1) << ELEM_ID_SHIFT;
+    size_t period = length - border[length - 1];
+    return length % period ? length : period;
+}
+
+static void load_ends(const code_elem_t* code, size_t length, ends_t& ends)
+{
+    load_partners(code, length, ends.partner);
+    ends.period = code_period(code, length, ends.partner.data());
+}
+
+// the ends of the code every enumerator below is going over, loaded once
+// for all the kinds of moves
+static thread_local ends_t code_ends;
+
+// the faces of a code being moved, to work out the genus of what it's
+// moved to from what the move changes instead of going around every face
+// again (classical knots only)
+// R1 and R3 moves never change the genus, and R2 moves change it by one
+// depending on whether the strands they touch go around the same face
+typedef struct faces_t {
+    int genus;
+    std::vector<uint32_t> face;
+} faces_t;
+
+#ifndef FLAT_KNOTS
+static void load_faces(const code_elem_t* code, size_t length, faces_t& faces)
+{
+    size_t count = code_faces(code, length, faces.face);
+    faces.genus = length ? (int) (2 + length / 2 - count) / 2 : 0;
+}
+#endif
+
+// the choices of flags an undo move goes through at every position
+#ifdef FLAT_KNOTS
+static const uint8_t r1_undo_choices = 2, r2_undo_choices = 4;
+#else
+static const uint8_t r1_undo_choices = 4, r2_undo_choices = 8;
+#endif
+
+// inserts a R1 move before x
+// positive         - if the (first, for flat knots) sign is positive
+// first_over       - if first element is over
+static void r1_undo(const code_elem_t* code, size_t length, code_elem_t id, size_t x,
+                    bool positive, bool first_over, code_elem_t* moved)
+{
+    code_elem_t first = id << ELEM_ID_SHIFT;
     if (positive) {
         first |= ELEM_POSITIVE;
     }
@@ -62,146 +223,139 @@ static code_t r1_undo_unsan(code_t code, size_t x, bool positive, bool first_ove
     }
 #endif
 
+    std::copy(code, code + x, moved);
     // the second is the same as first, just with OVER/SIGN bit reversed
-    code_t ins; ins.push_back(first);
+    moved[x] = first;
 #ifndef FLAT_KNOTS
-    ins.push_back(first ^ ELEM_OVER);
+    moved[x + 1] = first ^ ELEM_OVER;
 #else
-    ins.push_back(first ^ ELEM_POSITIVE);
+    moved[x + 1] = first ^ ELEM_POSITIVE;
 #endif
-    code.insert(code.begin() + x, ins.begin(), ins.end());
-
-    return code;
+    std::copy(code + x, code + length, moved + x + 2);
 }
 
-// inserts a R1 move before x
-// positive         - if the sign is positive
-// first_over       - if first element is over
-#ifdef FLAT_KNOTS
-static code_t r1_undo(code_t code, size_t x, bool positive)
-#else
-static code_t r1_undo(code_t code, size_t x, bool positive, bool first_over)
-#endif
+// the flags of the first element r1_undo puts in, from the choices it
+// takes as the bits of i (as the enumerators go over them)
+static code_elem_t r1_undo_first(int i)
 {
-#ifdef FLAT_KNOTS
-    code = r1_undo_unsan(code, x, positive);
-#else
-    code = r1_undo_unsan(code, x, positive, first_over);
+    code_elem_t first = (i & 1) ? ELEM_POSITIVE : 0;
+#ifndef FLAT_KNOTS
+    if ((i >> 1) & 1) {
+        first |= ELEM_OVER;
+    }
 #endif
 
-    // standardize it
-    renumber_code(code, code.size() / 2);
-    return first_ordered_code(code);
+    return first;
 }
 
-#ifdef FLAT_KNOTS
-std::vector<code_t> r1_undo_raw_enumerate(const code_t& code, code_t (*r1_undo)(code_t, size_t, bool))
-#else
-std::vector<code_t> r1_undo_raw_enumerate(const code_t& code, code_t (*r1_undo)(code_t, size_t, bool, bool))
-#endif
+// if the R1 move r1_undo puts in before x, starting with first (just its
+// flags), makes the same diagram as one which comes before it
+// putting it in right before or right after a kink just like it makes the
+// same diagram, as does putting it in at places the code can be rotated
+// between, so only the first of each of those is made
+static bool r1_undo_redundant(const code_elem_t* code, size_t length, const size_t* partner, size_t period,
+                              size_t x, code_elem_t first)
 {
-    std::vector<code_t> list; size_t length = code.size();
-    size_t x = 0;
-    do {
+    if (!length) {
+        // either end of the kink can be the first
 #ifdef FLAT_KNOTS
-        list.push_back(r1_undo(code, x, false));
-        list.push_back(r1_undo(code, x, true));   
+        return first & ELEM_POSITIVE;
 #else
-        // 4 possible choices, so just go over all of them
-        for (int i = 0; i < 4; i++) {
-            list.push_back(r1_undo(code, x, (i >> 0) & 1, (i >> 1) & 1));
-        }
+        return first & ELEM_OVER;
 #endif
-        x++;
-    } while (x < length);
+    }
 
-    return list;
-}
+    if (x >= period) {
+        return true;
+    }
 
-std::vector<code_t> r1_undo_enumerate(const code_t& code)
-{
-    return r1_undo_raw_enumerate(code, r1_undo);
+    // a kink just like it right before it (which it would have gone in
+    // before), or right after it, going around the end
+    size_t before = (x + length - 2) % length, after = x;
+    if (before < x && partner[before] == (before + 1) % length && (code[before] & ELEM_FLAGS_MASK) == first) {
+        return true;
+    }
+    if ((after + 2) % length < x && partner[after] == (after + 1) % length &&
+        (code[after] & ELEM_FLAGS_MASK) == first) {
+        return true;
+    }
+
+    return false;
 }
 
-std::vector<code_t> r1_undo_unsan_enumerate(const code_t& code)
+// only puts out moves r1_undo_redundant lets through, and if sanitize is
+// set only one of any that make the same diagram
+static void r1_undo_list(const code_elem_t* code, size_t length, code_list_t& out, bool sanitize,
+                         const ends_t& ends, size_t begin = 0, size_t end = SIZE_MAX)
 {
-    return r1_undo_raw_enumerate(code, r1_undo_unsan);
+    code_elem_t id = next_id(code, length);
+    size_t places = std::max(length, (size_t) 1), avoided = 0;
+    end = std::min(end, places);
+    scratch.resize(length + 2);
+
+    for (size_t x = begin; x < end; x++) {
+        // 4 possible choices (2 for flat knots), so just go over all of them
+        for (int i = 0; i < r1_undo_choices; i++) {
+            if (r1_undo_redundant(code, length, ends.partner.data(), ends.period, x, r1_undo_first(i))) {
+                avoided++;
+                continue;
+            }
+
+#ifdef FLAT_KNOTS
+            r1_undo(code, length, id, x, i & 1, false, scratch.data());
+#else
+            r1_undo(code, length, id, x, (i >> 0) & 1, (i >> 1) & 1, scratch.data());
+#endif
+            emit(out, scratch.data(), length + 2, sanitize);
+        }
+    }
+
+    undo_candidates += (end - std::min(begin, end)) * r1_undo_choices;
+    undo_avoided += avoided;
 }
 
 // do a R1 move on x
-static code_t r1_do_unsan(const code_t& code, size_t x)
+static void r1_do(const code_elem_t* code, size_t length, size_t x, code_elem_t* moved)
 {
-    code_t moved; size_t length = code.size();
+    size_t j = 0;
     for (size_t i = 0; i < length; i++) {
         if ((i == x) || (i == ((x + 1) % length))) {
             // if these are it
             continue;
         }
 
-        moved.push_back(code[i]);
+        moved[j++] = code[i];
     }
-
-    return moved;
-}
-
-// do a R1 move on x
-static code_t r1_do(const code_t& code, size_t x)
-{
-    code_t moved = r1_do_unsan(code, x);
-
-    renumber_code(moved, code.size() / 2);
-    return first_ordered_code(moved);
 }
 
-std::vector<code_t> r1_do_raw_enumerate(const code_t& code, code_t (*r1_do)(const code_t&, size_t))
+static void r1_do_list(const code_elem_t* code, size_t length, code_list_t& out, bool sanitize,
+                       size_t begin = 0, size_t end = SIZE_MAX)
 {
-    std::vector<code_t> list; size_t length = code.size();
     if (length < 2) {
-        return list;
+        return;
     }
 
-    for (size_t x = 0; x < length; x++) {
+    scratch.resize(length);
+    for (size_t x = begin; x < std::min(end, length); x++) {
         size_t x_ = (x + 1) % length;
         // check if x and x_ meet the requirements
         if (ELEM_ID(code[x]) == ELEM_ID(code[x_])) {
-            list.push_back(r1_do(code, x));
+            r1_do(code, length, x, scratch.data());
+            emit(out, scratch.data(), length - 2, sanitize);
         }
     }
-
-    return list;
-}
-
-std::vector<code_t> r1_do_enumerate(const code_t& code)
-{
-    return r1_do_raw_enumerate(code, r1_do);
-}
-
-std::vector<code_t> r1_do_unsan_enumerate(const code_t& code)
-{
-    return r1_do_raw_enumerate(code, r1_do_unsan);
 }
 
 // inserts a R2 move before y and x, in that order
 // first_positive   - if first ID is positive
 // first_over       - if first pair is over
 // flip             - if the order is flipped in second part
-#ifdef FLAT_KNOTS
-static code_t r2_undo_unsan(code_t code, size_t x, size_t y,
-               bool first_positive, bool flip)
-#else
-static code_t r2_undo_unsan(code_t code, size_t x, size_t y,
-               bool first_positive, bool first_over, bool flip)
-#endif
+static void r2_undo(const code_elem_t* code, size_t length, code_elem_t id, size_t x, size_t y,
+                    bool first_positive, bool first_over, bool flip, code_elem_t* moved)
 {
     code_elem_t first, second, third, fourth;
 
-    ssize_t max = -1;
-    for (auto iter: code) {
-        max = std::max(max, (ssize_t) ELEM_ID(iter));
-    }
-
-    first = (max + 1) << ELEM_ID_SHIFT; second = (max + 2) << ELEM_ID_SHIFT;
-    // first = (code.size() / 2) << ELEM_ID_SHIFT; second = (code.size() / 2 + 1) << ELEM_ID_SHIFT;
+    first = id << ELEM_ID_SHIFT; second = (id + 1) << ELEM_ID_SHIFT;
     if (first_positive) {
         first |= ELEM_POSITIVE;
     } else {
@@ -233,83 +387,233 @@ static code_t r2_undo_unsan(code_t code, size_t x, size_t y,
     }
 #endif
 
-    code_t ins_1; ins_1.push_back(third); ins_1.push_back(fourth);
-    code.insert(code.begin() + y, ins_1.begin(), ins_1.end());
-    code_t ins_2; ins_2.push_back(first); ins_2.push_back(second);
-    code.insert(code.begin() + x, ins_2.begin(), ins_2.end());
-
-    return code;
+    // x <= y, so the first pair goes in before the second
+    std::copy(code, code + x, moved);
+    moved[x] = first; moved[x + 1] = second;
+    std::copy(code + x, code + y, moved + x + 2);
+    moved[y + 2] = third; moved[y + 3] = fourth;
+    std::copy(code + y, code + length, moved + y + 4);
 }
 
-// inserts a R2 move before y and x, in that order
-// first_positive   - if first ID is positive
-// first_over       - if first pair is over
-// flip             - if the order is flipped in second part
+// the flags of the element on the other end of the chord from one with
+// flags end
+static inline code_elem_t other_end(code_elem_t end)
+{
 #ifdef FLAT_KNOTS
-static code_t r2_undo(code_t code, size_t x, size_t y,
-               bool first_positive, bool flip)
+    return end ^ ELEM_POSITIVE;
 #else
-static code_t r2_undo(code_t code, size_t x, size_t y,
-               bool first_positive, bool first_over, bool flip)
+    return end ^ ELEM_OVER;
 #endif
+}
+
+// the R2 move r2_undo makes putting a (the flags of two elements) in at gap
+// a_gap and b in at gap b_gap (a first if they're the same gap), where
+// a[0] is on the same chord as b[0] if parallel, or b[1] if not
+// gaps are counted as the position they go in before
+static move_t r2_undo_move(size_t a_gap, const code_elem_t* a, size_t b_gap, const code_elem_t* b, bool parallel)
 {
+    if (b_gap < a_gap) {
+        std::swap(a_gap, b_gap); std::swap(a, b);
+    }
+
+    move_t move;
+    move.type = MOVE_R2_UNDO;
+    move.x = a_gap; move.y = b_gap; move.z = 0;
+    move.flags = (a[0] & ELEM_POSITIVE) ? 1 : 0;
 #ifdef FLAT_KNOTS
-    code = r2_undo_unsan(code, x, y, first_positive, flip);
+    move.flags |= parallel ? 0 : 2;
 #else
-    code = r2_undo_unsan(code, x, y, first_positive, first_over, flip);
+    move.flags |= (a[0] & ELEM_OVER) ? 2 : 0;
+    move.flags |= parallel ? 0 : 4;
 #endif
-    renumber_code(code, code.size() / 2);
-    return first_ordered_code(code);
+
+    return move;
+}
+
+// if move comes before other in the order the enumerators go over them
+static inline bool r2_undo_before(const move_t& move, const move_t& other)
+{
+    if (move.x != other.x) return move.x < other.x;
+    if (move.y != other.y) return move.y < other.y;
+    return move.flags < other.flags;
+}
+
+static inline bool r2_undo_same(const move_t& move, const move_t& other)
+{
+    return move.x == other.x && move.y == other.y && move.flags == other.flags;
+}
+
+// if a chord joins the ends either side of the gaps at x and y
+static inline bool r2_undo_joined(size_t length, const size_t* partner, size_t x, size_t y)
+{
+    size_t x_before = (x + length - 1) % length, y_before = (y + length - 1) % length;
+    return partner[x_before] == y_before || partner[x_before] == y ||
+           partner[x] == y_before || partner[x] == y;
+}
+
+// if any of the R2 moves going in before x and y could be the same as an
+// earlier one, which they can't unless a chord P...Q (below) joins the
+// gaps or the code can be rotated onto itself, so the enumerators only
+// look at the choices for the few pairs of gaps that can
+static inline bool r2_undo_may_repeat(size_t length, const size_t* partner, size_t period, size_t x, size_t y)
+{
+    return length && (period != length || r2_undo_joined(length, partner, x, y));
 }
 
+// if the R2 move r2_undo puts in before x and y (with the choices as the
+// bits of i) makes the same diagram as one which comes before it
+// with a chord P...Q, two new chords put in right next to P and Q, with
+// the first new end the same as P, make the same diagram as putting them
+// in on the other sides of P and Q, as renumbering just shifts the three
+// chords along by one
+// this goes for both the crossing and side by side ways of putting them
+// in, and putting them in at places the code can be rotated between is
+// the same too
+static bool r2_undo_redundant(const code_elem_t* code, size_t length, const size_t* partner, size_t period,
+                              size_t x, size_t y, int i)
+{
+    if (!r2_undo_may_repeat(length, partner, period, x, y)) {
+        return false;
+    }
+    bool joined = r2_undo_joined(length, partner, x, y);
+
+    code_elem_t ends[4];
+    ends[0] = (i & 1) ? ELEM_POSITIVE : 0;
 #ifdef FLAT_KNOTS
-std::vector<code_t> r2_undo_raw_enumerate(const code_t& code,
-                                            code_t (*r2_undo)(code_t, size_t, size_t, bool, bool))
+    bool flip = (i >> 1) & 1;
 #else
-std::vector<code_t> r2_undo_raw_enumerate(const code_t& code,
-                                            code_t (*r2_undo)(code_t, size_t, size_t, bool, bool, bool))
+    if ((i >> 1) & 1) {
+        ends[0] |= ELEM_OVER;
+    }
+    bool flip = (i >> 2) & 1;
+#endif
+    ends[1] = ends[0] ^ ELEM_POSITIVE;
+    ends[2] = other_end(ends[flip ? 1 : 0]); ends[3] = other_end(ends[flip ? 0 : 1]);
+
+    move_t move = r2_undo_move(x, ends, y, ends + 2, !flip);
+
+    for (size_t k = period; k < length; k += period) {
+        if (r2_undo_before(r2_undo_move((x + k) % length, ends, (y + k) % length, ends + 2, !flip), move)) {
+            return true;
+        }
+    }
+
+    if (!joined) {
+        return false;
+    }
+
+    // P is at one of the ends of the gaps at x and y
+    size_t ps[4] = { x, y, (x + length - 1) % length, (y + length - 1) % length };
+    for (size_t j = 0; j < 4; j++) {
+        size_t p = ps[j], q = partner[p];
+        size_t p_ = (p + 1) % length, q_ = (q + 1) % length;
+
+        code_elem_t end = code[p] & ELEM_FLAGS_MASK, flipped = end ^ ELEM_POSITIVE;
+        code_elem_t around[2] = { end, flipped }, back[2] = { flipped, end };
+        code_elem_t around_[2] = { other_end(flipped), other_end(end) };
+        code_elem_t back_[2] = { other_end(end), other_end(flipped) };
+
+        // outside both ends, or inside both, crossing over
+        move_t outside = r2_undo_move(q_, around_, p, around, false);
+        move_t inside = r2_undo_move(p_, back, q, back_, false);
+        // before both ends, or after both, side by side
+        move_t before = r2_undo_move(p, around, q, back_, true);
+        move_t after = r2_undo_move(p_, back, q_, around_, true);
+
+        if ((r2_undo_same(move, outside) && r2_undo_before(inside, move)) ||
+            (r2_undo_same(move, inside) && r2_undo_before(outside, move)) ||
+            (r2_undo_same(move, before) && r2_undo_before(after, move)) ||
+            (r2_undo_same(move, after) && r2_undo_before(before, move))) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#ifndef FLAT_KNOTS
+// the genus after a R2 move inserted by r2_undo, from the faces before it
+// the two new crossings only bound a new face, leaving the genus alone, if
+// the two strands went around the same face on the sides they're pushed
+// over from, which depends on the flags
+static int r2_undo_genus(const faces_t& faces, const code_elem_t* moved, size_t length, size_t x, size_t y,
+                         bool first_positive, bool first_over, bool flip)
+{
+    if (!length) {
+        return genus(moved, 4);
+    }
+
+    bool twist = first_positive != first_over;
+    size_t before_x = (twist != flip) ? 2 * ((x + length - 1) % length) : 2 * x + 1;
+    size_t before_y = twist ? 2 * y + 1 : 2 * ((y + length - 1) % length);
+
+    return faces.genus + (faces.face[before_x] != faces.face[before_y]);
+}
 #endif
+
+// if genera is given, the genus of each move (worked out from faces) is put
+// onto the end of it, and if planar is set only moves which leave a planar
+// code planar are built
+static void r2_undo_genus_list(const code_elem_t* code, size_t length, code_list_t& out, bool sanitize,
+                               const ends_t& ends, const faces_t* faces, std::vector<int>* genera,
+                               bool planar, size_t begin = 0, size_t end = SIZE_MAX)
 {
-    std::vector<code_t> list; size_t length = code.size();
-    size_t x = 0, y = 0;
-    do {
-        y = x;
-        do {
+    code_elem_t id = next_id(code, length);
+    size_t places = std::max(length, (size_t) 1), candidates = 0, avoided = 0;
+    scratch.resize(length + 4);
+
+    for (size_t x = begin; x < std::min(end, places); x++) {
+        candidates += (places - x) * r2_undo_choices;
+        for (size_t y = x; y < places; y++) {
+            bool may_repeat = r2_undo_may_repeat(length, ends.partner.data(), ends.period, x, y);
 #ifdef FLAT_KNOTS
             // 4 possible choices, so just go over all of them
             for (int i = 0; i < 4; i++) {
-                list.push_back(r2_undo(code, x, y, (i >> 0) & 1, (i >> 1) & 1));
+                if (may_repeat && r2_undo_redundant(code, length, ends.partner.data(), ends.period, x, y, i)) {
+                    avoided++;
+                    continue;
+                }
+
+                r2_undo(code, length, id, x, y, (i >> 0) & 1, false, (i >> 1) & 1, scratch.data());
+                emit(out, scratch.data(), length + 4, sanitize);
             }
 #else
             // 8 possible choices, so just go over all of them
             for (int i = 0; i < 8; i++) {
-                list.push_back(r2_undo(code, x, y, (i >> 0) & 1, (i >> 1) & 1, (i >> 2) & 1));
-            }
-#endif
-
-            y++;
-        } while (y < length);
-        x++;
-    } while (x < length);
+                if (may_repeat && r2_undo_redundant(code, length, ends.partner.data(), ends.period, x, y, i)) {
+                    avoided++;
+                    continue;
+                }
 
-    return list;
-}
+                // the faces are enough to tell, unless there's nothing there
+                if (planar && length && r2_undo_genus(*faces, NULL, length, x, y,
+                                                      (i >> 0) & 1, (i >> 1) & 1, (i >> 2) & 1)) {
+                    continue;
+                }
 
+                r2_undo(code, length, id, x, y, (i >> 0) & 1, (i >> 1) & 1, (i >> 2) & 1, scratch.data());
+                if (planar && !length && genus(scratch.data(), 4)) {
+                    continue;
+                }
 
-std::vector<code_t> r2_undo_enumerate(const code_t& code)
-{
-    return r2_undo_raw_enumerate(code, r2_undo);
-}
+                emit(out, scratch.data(), length + 4, sanitize);
+                if (genera) {
+                    genera->push_back(r2_undo_genus(*faces, scratch.data(), length, x, y,
+                                                    (i >> 0) & 1, (i >> 1) & 1, (i >> 2) & 1));
+                }
+            }
+#endif
+        }
+    }
 
-std::vector<code_t> r2_undo_unsan_enumerate(const code_t& code)
-{
-    return r2_undo_raw_enumerate(code, r2_undo_unsan);
+    undo_candidates += candidates;
+    undo_avoided += avoided;
 }
 
 // do a R2 move on x and y
-static code_t r2_do_unsan(const code_t& code, size_t x, size_t y)
+static void r2_do(const code_elem_t* code, size_t length, size_t x, size_t y, code_elem_t* moved)
 {
-    code_t moved; size_t length = code.size();
+    size_t j = 0;
     for (size_t i = 0; i < length; i++) {
         if ((i == x) || (i == ((x + 1) % length)) ||
             (i == y) || (i == ((y + 1) % length))) {
@@ -317,109 +621,151 @@ static code_t r2_do_unsan(const code_t& code, size_t x, size_t y)
             continue;
         }
 
-        moved.push_back(code[i]);
+        moved[j++] = code[i];
+    }
+}
+
+#ifndef FLAT_KNOTS
+// the genus after a R2 move done by r2_do, from the faces before it
+// taking out the two crossings merges the faces either side of the strands
+// (leaving the genus alone) unless they were the same face already, and
+// which faces those are depends on the flags and which way round the
+// strands go
+static int r2_do_genus(const faces_t& faces, const code_elem_t* code, size_t length, size_t x, size_t y)
+{
+    if (length == 4) {
+        return 0;
+    }
+
+    bool twist = !(code[x] & ELEM_OVER) != !(code[x] & ELEM_POSITIVE);
+    bool parallel = ELEM_ID(code[x]) == ELEM_ID(code[y]);
+
+    size_t a, b;
+    if (twist && !parallel) {
+        a = 2 * x + 1; b = 2 * y + 1;
+    } else if (!twist && parallel) {
+        a = 2 * ((y + length - 1) % length); b = 2 * ((y + 1) % length);
+    } else {
+        a = 2 * ((x + length - 1) % length); b = 2 * ((x + 1) % length);
     }
 
-    return moved;
+    return faces.genus - (faces.face[a] == faces.face[b]);
 }
+#endif
 
-// do a R2 move on x and y
-static code_t r2_do(const code_t& code, size_t x, size_t y)
+// the places y (from x + 2 on, in order) a R2 move can be done with x,
+// which have to be the other ends of the chords at x and x_, so there's at
+// most two
+static size_t r2_do_candidates(const code_elem_t* code, size_t length, const size_t* partner, size_t x,
+                               size_t* ys)
 {
-    code_t moved = r2_do_unsan(code, x, y);
+    size_t x_ = x + 1;
+    // check if x and x_ meet the requirements
+    if ((code[x] & ELEM_SIGN_MASK) == (code[x_] & ELEM_SIGN_MASK)) {
+        return 0;
+    }
+
+#ifndef FLAT_KNOTS
+    if ((code[x] & ELEM_OU_MASK) != (code[x_] & ELEM_OU_MASK)) {
+        return 0;
+    }
+#endif
+
+    // y and y_ are the ends of x_ and x, or of x and x_
+    size_t count = 0, tries[2] = { partner[x_], partner[x] };
+    size_t others[2] = { partner[x], partner[x_] };
+    for (size_t i = 0; i < 2; i++) {
+        size_t y = tries[i], y_ = (y + 1) % length;
+        // can't overlap
+        if (y >= x + 2 && y_ != x && y_ == others[i]) {
+            ys[count++] = y;
+        }
+    }
 
-    renumber_code(moved, code.size() / 2);
-    return first_ordered_code(moved);
+    if (count == 2 && ys[1] < ys[0]) {
+        std::swap(ys[0], ys[1]);
+    }
+    return count;
 }
 
-std::vector<code_t> r2_do_raw_enumerate(const code_t& code, code_t (*r2_do)(const code_t&, size_t, size_t))
+// if genera is given, the genus of each move (worked out from faces) is put
+// onto the end of it, and if planar is set only moves which make a planar
+// code are built
+// y is only tried where the chords at x could put it, so it's linear
+static void r2_do_genus_list(const code_elem_t* code, size_t length, code_list_t& out, bool sanitize,
+                             const ends_t& ends, const faces_t* faces, std::vector<int>* genera,
+                             bool planar, size_t begin = 0, size_t end = SIZE_MAX)
 {
-    std::vector<code_t> list; int length = code.size();
+    scratch.resize(length);
+
+    size_t ys[2];
+    for (size_t x = begin; x < end && x + 2 < length; x++) {
+        size_t count = r2_do_candidates(code, length, ends.partner.data(), x, ys);
+        for (size_t i = 0; i < count; i++) {
+            size_t y = ys[i];
+#ifndef FLAT_KNOTS
+            if (planar && r2_do_genus(*faces, code, length, x, y)) {
+                continue;
+            }
+#endif
+
+            r2_do(code, length, x, y, scratch.data());
+            emit(out, scratch.data(), length - 4, sanitize);
+#ifndef FLAT_KNOTS
+            if (genera) {
+                genera->push_back(r2_do_genus(*faces, code, length, x, y));
+            }
+#endif
+        }
+    }
+}
 
-    for (int x = 0; x < length - 2; x++) {
+#ifdef TEST_MOVES
+// the same, trying every y for each x, which the above is checked against
+static void r2_do_quadratic_list(const code_elem_t* code, size_t length, code_list_t& out)
+{
+    scratch.resize(length);
+    for (size_t x = 0; x + 2 < length; x++) {
         size_t x_ = x + 1;
-        // check if x and x_ meet the requirements
-        code_elem_t id_x = code[x], id_x_ = code[x_];
-        if ((id_x & ELEM_SIGN_MASK) == (id_x_ & ELEM_SIGN_MASK)) {
+        if ((code[x] & ELEM_SIGN_MASK) == (code[x_] & ELEM_SIGN_MASK)) {
             continue;
         }
 
 #ifndef FLAT_KNOTS
-        if ((id_x & ELEM_OU_MASK) != (id_x_ & ELEM_OU_MASK)) {
+        if ((code[x] & ELEM_OU_MASK) != (code[x_] & ELEM_OU_MASK)) {
             continue;
         }
 #endif
 
-        id_x = ELEM_ID(id_x); id_x_ = ELEM_ID(id_x_);
-
+        code_elem_t id_x = ELEM_ID(code[x]), id_x_ = ELEM_ID(code[x_]);
         for (size_t y = x + 2; y < length; y++) {
             size_t y_ = (y + 1) % length;
-            // can't overlap
             if (y_ == x) continue;
 
             if ((id_x == ELEM_ID(code[y_]) && id_x_ == ELEM_ID(code[y])) ||
                 (id_x == ELEM_ID(code[y]) && id_x_ == ELEM_ID(code[y_]))) {
-                list.push_back(r2_do(code, x, y));
-                continue;
+                r2_do(code, length, x, y, scratch.data());
+                emit(out, scratch.data(), length - 4, false);
             }
         }
     }
-
-    return list;
-}
-
-std::vector<code_t> r2_do_enumerate(const code_t& code)
-{
-    return r2_do_raw_enumerate(code, r2_do);
-}
-
-std::vector<code_t> r2_do_unsan_enumerate(const code_t& code)
-{
-    return r2_do_raw_enumerate(code, r2_do_unsan);
 }
+#endif
 
 // a R3 move at x, y, z presuming it's valid
-// don't renumber or reorder
-static code_t r3_vanilla(code_t code, size_t x, size_t y, size_t z)
-{
-    size_t length = code.size();
-    code_elem_t temp;
-
-    temp = code[x];
-    code[x] = code[(x + 1) % length];
-    code[(x + 1) % length] = temp;
-
-    temp = code[y];
-    code[y] = code[(y + 1) % length];
-    code[(y + 1) % length] = temp;
-
-    temp = code[z];
-    code[z] = code[(z + 1) % length];
-    code[(z + 1) % length] = temp;
-
-    return code;
-}
-
-// a R3 move, and renumber and reorder
-static code_t r3_unsan(const code_t& code, size_t x, size_t y, size_t z)
-{
-    return r3_vanilla(code, x, y, z);
-}
-
-// a R3 move, and renumber and reorder
-static code_t r3(const code_t& code, size_t x, size_t y, size_t z)
+static void r3(const code_elem_t* code, size_t length, size_t x, size_t y, size_t z, code_elem_t* moved)
 {
-    code_t moved = r3_vanilla(code, x, y, z);
+    std::copy(code, code + length, moved);
 
-    renumber_code(moved, moved.size() / 2);
-    return first_ordered_code(moved);
+    std::swap(moved[x], moved[(x + 1) % length]);
+    std::swap(moved[y], moved[(y + 1) % length]);
+    std::swap(moved[z], moved[(z + 1) % length]);
 }
 
-static bool is_triangular(const code_t& code, size_t x, size_t x_,
-                                              size_t y, size_t y_,
-                                              size_t z, size_t z_)
+static bool is_triangular(const code_elem_t* code, size_t x, size_t x_,
+                                                   size_t y, size_t y_,
+                                                   size_t z, size_t z_)
 {
-    size_t length = code.size();
     code_elem_t first = ELEM_ID(code[x]),
                 second = ELEM_ID(code[x_]),
                 third = ELEM_ID(code[y_]);
@@ -465,11 +811,10 @@ static bool is_triangular(const code_t& code, size_t x, size_t x_,
 
 // the case with the single crossing (single crossing, triangular,
 // crossingular...)
-static bool is_crossingular(const code_t& code, size_t x, size_t x_,
-                                                size_t y, size_t y_,
-                                                size_t z, size_t z_)
+static bool is_crossingular(const code_elem_t* code, size_t x, size_t x_,
+                                                     size_t y, size_t y_,
+                                                     size_t z, size_t z_)
 {
-    size_t length = code.size();
     code_elem_t first = ELEM_ID(code[x]),
                 second = ELEM_ID(code[x_]),
                 third = ELEM_ID(code[y_]);
@@ -540,11 +885,11 @@ static bool is_crossingular(const code_t& code, size_t x, size_t x_,
 }
 
 // check if we can do a r3 move at x, y, z
-static bool can_r3(const code_t& code, size_t x, size_t y, size_t z)
+static bool can_r3(const code_elem_t* code, size_t length, size_t x, size_t y, size_t z)
 {
     // note: horrible, HORRIBLE, code, but I could not think of a better way to do this
 
-    size_t x_ = (x + 1) % code.size(), y_ = (y + 1) % code.size(), z_ = (z + 1) % code.size();
+    size_t x_ = (x + 1) % length, y_ = (y + 1) % length, z_ = (z + 1) % length;
 
     // see if they match these without swapping
     if (is_triangular(code, x, x_, y, y_, z, z_) || is_crossingular(code, x, x_, y, y_, z, z_) ||
@@ -555,114 +900,798 @@ static bool can_r3(const code_t& code, size_t x, size_t y, size_t z)
     return false;
 }
 
-std::vector<code_t> r3_raw_enumerate(const code_t& code, code_t (*r3)(const code_t&, size_t, size_t, size_t))
+// the moves can_r3 could allow with x as the first position, as how far on
+// from x y and z are, in the order going over y then z from x would find
+// them
+// every case of can_r3 needs y or y_ to be the other end of x or x_, and
+// z or z_ to be the other end of the other one, so there are at most
+// eight to try
+static size_t r3_candidates(size_t length, const size_t* partner, size_t x,
+                            std::pair<size_t, size_t>* candidates)
 {
-    std::vector<code_t> list; size_t length = code.size();
-    if (length < 6) {
-        // need at least 3 chords
-        return list;
+    size_t x_ = (x + 1) % length;
+    size_t px = partner[x], px_ = partner[x_];
+    size_t ys[2] = { px_, (px + length - 1) % length };
+    size_t zs[4] = { (px + length - 1) % length, px, px_, (px_ + length - 1) % length };
+
+    size_t count = 0;
+    for (size_t i = 0; i < 2; i++) {
+        // leaving room for the pairs at z and x after it
+        size_t y_off = (ys[i] + length - x) % length;
+        if (y_off < 2 || y_off + 4 > length) {
+            continue;
+        }
+
+        for (size_t j = 0; j < 4; j++) {
+            size_t z_off = (zs[j] + length - x) % length;
+            if (z_off >= y_off + 2 && z_off + 2 <= length) {
+                candidates[count++] = std::make_pair(y_off, z_off);
+            }
+        }
+    }
+
+    std::sort(candidates, candidates + count);
+    return std::unique(candidates, candidates + count) - candidates;
+}
+
+// rather than trying every x, y and z, y and z are only tried where the
+// chords at x could put them, so it's linear
+static void r3_list(const code_elem_t* code, size_t length, code_list_t& out, bool sanitize,
+                    const ends_t& ends, size_t begin = 0, size_t end = SIZE_MAX)
+{
+    if (length < 6) {
+        // need at least 3 chords
+        return;
+    }
+
+    const size_t* partner = ends.partner.data();
+
+    scratch.resize(length);
+    std::pair<size_t, size_t> candidates[8];
+    for (size_t x = begin; x < std::min(end, length); x++) {
+        size_t count = r3_candidates(length, partner, x, candidates);
+        for (size_t i = 0; i < count; i++) {
+            size_t y = (x + candidates[i].first) % length, z = (x + candidates[i].second) % length;
+            if (can_r3(code, length, x, y, z)) {
+                r3(code, length, x, y, z, scratch.data());
+                emit(out, scratch.data(), length, sanitize);
+            }
+        }
+    }
+}
+
+#ifdef TEST_MOVES
+// the same, trying every x, y and z, which the above is checked against
+static void r3_cubic_list(const code_elem_t* code, size_t length, code_list_t& out)
+{
+    if (length < 6) {
+        return;
     }
 
+    scratch.resize(length);
     for (size_t x = 0; x < length; x++) {
         for (size_t y = (x + 2) % length; (y + 3) % length != x; y = (y + 1) % length) {
             for (size_t z = (y + 2) % length; (z + 1) % length != x; z = (z + 1) % length) {
-                if (can_r3(code, x, y, z)) {
-                    list.push_back(r3(code, x, y, z));
+                if (can_r3(code, length, x, y, z)) {
+                    r3(code, length, x, y, z, scratch.data());
+                    emit(out, scratch.data(), length, false);
                 }
             }
         }
     }
+}
+#endif
+
+void move_iter_start(move_iter_t& iter, const code_elem_t* code, size_t length, int types)
+{
+    iter.code = code; iter.length = length; iter.types = types;
+    iter.type = 0; iter.started = false;
+    load_ends(code, length, iter.ends);
+}
+
+// the places to try for the current x, for the moves which have them
+static void move_candidates(move_iter_t& iter)
+{
+    const move_t& move = iter.move;
+    iter.candidate = -1;
+
+    if (move.type == MOVE_R2_DO) {
+        size_t ys[2];
+        iter.candidate_count = r2_do_candidates(iter.code, iter.length, iter.ends.partner.data(), move.x, ys);
+        for (size_t i = 0; i < iter.candidate_count; i++) {
+            iter.candidates[i] = std::make_pair(ys[i] - move.x, (size_t) 0);
+        }
+    } else {
+        iter.candidate_count = r3_candidates(iter.length, iter.ends.partner.data(), move.x, iter.candidates);
+    }
+}
+
+// put the move at the first place its type goes through, returning false
+// if there's nowhere
+static bool move_first(move_iter_t& iter)
+{
+    move_t& move = iter.move;
+    size_t length = iter.length;
+    move.type = 1 << iter.type; move.x = move.y = move.z = 0; move.flags = 0;
+
+    switch (move.type) {
+    case MOVE_R1_DO:
+        return length >= 2;
+    case MOVE_R2_DO:
+    case MOVE_R3:
+        if (length < (move.type == MOVE_R2_DO ? 3 : 6)) {
+            return false;
+        }
+        move_candidates(iter);
+        return true;
+    default:
+        // undo moves go in even with nothing there
+        return true;
+    }
+}
+
+// move on to the next place the move's type goes through, returning false
+// once it's been everywhere
+static bool move_step(move_iter_t& iter)
+{
+    move_t& move = iter.move;
+    size_t length = iter.length, places = std::max(length, (size_t) 1);
+
+    switch (move.type) {
+    case MOVE_R1_DO:
+        return ++move.x < length;
+    case MOVE_R1_UNDO:
+        if (++move.flags < r1_undo_choices) return true;
+        move.flags = 0;
+        return ++move.x < places;
+    case MOVE_R2_UNDO:
+        if (++move.flags < r2_undo_choices) return true;
+        move.flags = 0;
+        if (++move.y < places) return true;
+        move.x++; move.y = move.x;
+        return move.x < places;
+    case MOVE_R2_DO:
+    case MOVE_R3: {
+        size_t end = move.type == MOVE_R2_DO ? length - 2 : length;
+        while (++iter.candidate >= iter.candidate_count) {
+            if (++move.x >= end) {
+                return false;
+            }
+            move_candidates(iter);
+        }
+        move.y = (move.x + iter.candidates[iter.candidate].first) % length;
+        if (move.type == MOVE_R3) {
+            move.z = (move.x + iter.candidates[iter.candidate].second) % length;
+        }
+        return true;
+    }
+    }
+
+    return false;
+}
+
+// if the move is one the enumerators would make
+static bool move_valid(const move_iter_t& iter)
+{
+    const move_t& move = iter.move;
+    const code_elem_t* code = iter.code;
+    size_t length = iter.length;
+
+    switch (move.type) {
+    case MOVE_R1_DO:
+        return ELEM_ID(code[move.x]) == ELEM_ID(code[(move.x + 1) % length]);
+    case MOVE_R1_UNDO:
+        return !r1_undo_redundant(code, length, iter.ends.partner.data(), iter.ends.period, move.x,
+                                  r1_undo_first(move.flags));
+    case MOVE_R2_UNDO:
+        return !r2_undo_redundant(code, length, iter.ends.partner.data(), iter.ends.period, move.x, move.y,
+                                  move.flags);
+    case MOVE_R3:
+        return can_r3(code, length, move.x, move.y, move.z);
+    }
+
+    // R2 moves are only found where they can be done
+    return true;
+}
+
+// the next move, in the same order the enumerators give their neighbors
+bool move_iter_next(move_iter_t& iter, move_t& move)
+{
+    while (iter.type < MOVE_TYPES) {
+        if (!(iter.types & (1 << iter.type))) {
+            iter.type++;
+            continue;
+        }
+
+        bool more;
+        if (!iter.started) {
+            more = move_first(iter);
+            iter.started = true;
+            if (more && (iter.move.type == MOVE_R2_DO || iter.move.type == MOVE_R3)) {
+                // the first candidate is only looked at by stepping
+                more = move_step(iter);
+            }
+        } else {
+            more = move_step(iter);
+        }
+
+        if (!more) {
+            iter.type++; iter.started = false;
+            continue;
+        }
+
+        if (move_valid(iter)) {
+            move = iter.move;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// the length of the code after a move of this type
+size_t move_length(size_t length, int type)
+{
+    switch (type) {
+    case MOVE_R1_DO: return length - 2;
+    case MOVE_R1_UNDO: return length + 2;
+    case MOVE_R2_DO: return length - 4;
+    case MOVE_R2_UNDO: return length + 4;
+    default: return length;
+    }
+}
+
+// write the code after the move, without renumbering or ordering it, into
+// moved, which needs room for move_length elements
+void move_apply(const code_elem_t* code, size_t length, const move_t& move, code_elem_t* moved)
+{
+    switch (move.type) {
+    case MOVE_R1_DO:
+        r1_do(code, length, move.x, moved);
+        break;
+    case MOVE_R1_UNDO:
+#ifdef FLAT_KNOTS
+        r1_undo(code, length, next_id(code, length), move.x, move.flags & 1, false, moved);
+#else
+        r1_undo(code, length, next_id(code, length), move.x, move.flags & 1, (move.flags >> 1) & 1, moved);
+#endif
+        break;
+    case MOVE_R2_DO:
+        r2_do(code, length, move.x, move.y, moved);
+        break;
+    case MOVE_R2_UNDO:
+#ifdef FLAT_KNOTS
+        r2_undo(code, length, next_id(code, length), move.x, move.y,
+                move.flags & 1, false, (move.flags >> 1) & 1, moved);
+#else
+        r2_undo(code, length, next_id(code, length), move.x, move.y,
+                move.flags & 1, (move.flags >> 1) & 1, (move.flags >> 2) & 1, moved);
+#endif
+        break;
+    case MOVE_R3:
+        r3(code, length, move.x, move.y, move.z, moved);
+        break;
+    }
+}
+
+// the same, but renumbered and ordered
+void move_neighbor(const code_elem_t* code, size_t length, const move_t& move, code_elem_t* out)
+{
+    scratch.resize(move_length(length, move.type));
+    move_apply(code, length, move, scratch.data());
+    canonicalize_any_code(scratch.data(), scratch.size(), out);
+}
+
+// find a move (of the given types) from code to target, which has to be
+// renumbered and ordered, only building the neighbors which are the same
+// length as it
+bool find_move(const code_elem_t* code, size_t length, const code_elem_t* target, size_t target_length,
+               move_t& move, int types)
+{
+    static thread_local std::vector<code_elem_t> neighbor;
+    neighbor.resize(target_length);
+
+    move_iter_t iter;
+    move_iter_start(iter, code, length, types);
+    while (move_iter_next(iter, move)) {
+        if (move_length(length, move.type) != target_length) {
+            continue;
+        }
+
+        move_neighbor(code, length, move, neighbor.data());
+        if (std::equal(neighbor.begin(), neighbor.end(), target)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+move_stats_t move_stats()
+{
+    move_stats_t stats;
+    stats.candidates = undo_candidates.load();
+    stats.avoided = undo_avoided.load(); stats.dropped = undo_dropped.load();
+    return stats;
+}
+
+void move_reset_stats()
+{
+    undo_candidates = 0; undo_avoided = 0; undo_dropped = 0;
+}
+
+// codes shorter than this have all their moves gone through on the thread
+// asking for them, as handing them out costs more than it saves
+static const size_t enumerate_parallel_min = 48;
+
+// the moves of one type starting at x from begin up to end, which every
+// list above can be limited to, so a big code's moves can be split up
+typedef struct move_span_t {
+    int type;
+    size_t begin, end;
+} move_span_t;
+
+// put the moves in span onto the end of out, with the genus of each
+// (worked out from faces) onto the end of genera if given
+static void enumerate_span(const code_elem_t* code, size_t length, const move_span_t& span, code_list_t& out,
+                           bool sanitize, const ends_t& ends, const faces_t* faces, std::vector<int>* genera,
+                           bool planar)
+{
+    // only R2 do moves take the genus down, and only by one
+    if (planar && faces->genus > (span.type == MOVE_R2_DO)) {
+        return;
+    }
+
+    switch (span.type) {
+    case MOVE_R1_DO:
+        r1_do_list(code, length, out, sanitize, span.begin, span.end);
+        break;
+    case MOVE_R1_UNDO:
+        r1_undo_list(code, length, out, sanitize, ends, span.begin, span.end);
+        break;
+    case MOVE_R2_DO:
+        r2_do_genus_list(code, length, out, sanitize, ends, faces, genera, planar, span.begin, span.end);
+        break;
+    case MOVE_R2_UNDO:
+        r2_undo_genus_list(code, length, out, sanitize, ends, faces, genera, planar, span.begin, span.end);
+        break;
+    case MOVE_R3:
+        r3_list(code, length, out, sanitize, ends, span.begin, span.end);
+        break;
+    }
+
+    // R1 and R3 moves never change the genus
+    if (genera && span.type != MOVE_R2_DO && span.type != MOVE_R2_UNDO) {
+        genera->resize(code_list_size(out), faces->genus);
+    }
+}
+
+// split the moves of types into about parts spans each, in the order
+// they're enumerated in
+static void split_moves(size_t length, int types, size_t parts, std::vector<move_span_t>& spans)
+{
+    size_t places = std::max(length, (size_t) 1);
+    for (int type = 0; type < MOVE_TYPES; type++) {
+        if (!(types & (1 << type))) {
+            continue;
+        }
 
-    return list;
+        size_t begin = 0;
+        for (size_t i = 1; i <= parts; i++) {
+            size_t end = places * i / parts;
+            if (1 << type == MOVE_R2_UNDO) {
+                // R2 undo moves at x go through every y from x on, so the
+                // spans get wider as they go
+                end = places - (size_t) (places * std::sqrt((double) (parts - i) / parts));
+            }
+            if (end > begin) {
+                spans.push_back({ 1 << type, begin, end });
+                begin = end;
+            }
+        }
+    }
+}
+
+// put the moves of types onto the end of neighbors, in the order
+// r1_do, r1_undo, r2_do, r2_undo, r3, handing big codes out between
+// threads
+// if planar is set, only the moves which make a planar code (going by
+// faces) are put out
+static void enumerate_moves(const code_elem_t* code, size_t length, code_list_t& neighbors, int types,
+                            bool sanitize, const faces_t* faces, std::vector<int>* genera, bool planar = false)
+{
+    load_ends(code, length, code_ends);
+    // other threads have their own code_ends, so they're given this one
+    const ends_t& ends = code_ends;
+
+    if (length < enumerate_parallel_min || omp_in_parallel() || omp_get_max_threads() < 2) {
+        for (int type = 0; type < MOVE_TYPES; type++) {
+            if (types & (1 << type)) {
+                enumerate_span(code, length, { 1 << type, 0, SIZE_MAX }, neighbors, sanitize, ends,
+                               faces, genera, planar);
+            }
+        }
+        return;
+    }
+
+    std::vector<move_span_t> spans;
+    split_moves(length, types, 4 * omp_get_max_threads(), spans);
+
+    // every span goes into a part of its own, so putting the parts back
+    // together in order gives the same list as going through them in turn
+    std::vector<code_list_t> parts(spans.size());
+    std::vector<std::vector<int>> part_genera(genera ? spans.size() : 0);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t i = 0; i < spans.size(); i++) {
+        enumerate_span(code, length, spans[i], parts[i], sanitize, ends, faces,
+                       genera ? &part_genera[i] : NULL, planar);
+    }
+
+    for (size_t i = 0; i < spans.size(); i++) {
+        size_t start = neighbors.elems.size();
+        neighbors.elems.insert(neighbors.elems.end(), parts[i].elems.begin(), parts[i].elems.end());
+        for (size_t j = 1; j < parts[i].offsets.size(); j++) {
+            neighbors.offsets.push_back(start + parts[i].offsets[j]);
+        }
+        if (genera) {
+            genera->insert(genera->end(), part_genera[i].begin(), part_genera[i].end());
+        }
+    }
+}
+
+// run the moves of types into a fresh vector of codes
+static std::vector<code_t> enumerate_with(int type, const code_t& code, bool sanitize)
+{
+    code_list_t out;
+    enumerate_moves(code.data(), code.size(), out, type, sanitize, NULL, NULL);
+    return code_list_codes(out);
+}
+
+std::vector<code_t> r1_undo_enumerate(const code_t& code)
+{
+    code_list_t list;
+    enumerate_moves(code.data(), code.size(), list, MOVE_R1_UNDO, true, NULL, NULL);
+    drop_duplicates(list);
+    return code_list_codes(list);
+}
+
+std::vector<code_t> r1_undo_unsan_enumerate(const code_t& code)
+{
+    return enumerate_with(MOVE_R1_UNDO, code, false);
+}
+
+std::vector<code_t> r1_do_enumerate(const code_t& code)
+{
+    return enumerate_with(MOVE_R1_DO, code, true);
+}
+
+std::vector<code_t> r1_do_unsan_enumerate(const code_t& code)
+{
+    return enumerate_with(MOVE_R1_DO, code, false);
+}
+
+std::vector<code_t> r2_undo_enumerate(const code_t& code)
+{
+    // there's a lot of these, so canonicalize them all together
+    code_list_t raw, list;
+    enumerate_moves(code.data(), code.size(), raw, MOVE_R2_UNDO, false, NULL, NULL);
+    canonicalize_codes(raw, list);
+    drop_duplicates(list);
+    return code_list_codes(list);
+}
+
+std::vector<code_t> r2_undo_unsan_enumerate(const code_t& code)
+{
+    return enumerate_with(MOVE_R2_UNDO, code, false);
+}
+
+std::vector<code_t> r2_do_enumerate(const code_t& code)
+{
+    return enumerate_with(MOVE_R2_DO, code, true);
+}
+
+std::vector<code_t> r2_do_unsan_enumerate(const code_t& code)
+{
+    return enumerate_with(MOVE_R2_DO, code, false);
 }
 
 std::vector<code_t> r3_enumerate(const code_t& code)
 {
-    return r3_raw_enumerate(code, r3);
+    return enumerate_with(MOVE_R3, code, true);
 }
 
 std::vector<code_t> r3_unsan_enumerate(const code_t& code)
 {
-    return r3_raw_enumerate(code, r3_unsan);
+    return enumerate_with(MOVE_R3, code, false);
 }
 
-// enumerate neighbors of code
-std::vector<code_t> enumerate_complete_neighbors(const code_t& code)
+// enumerate neighbors of code onto the end of neighbors
+void enumerate_complete_neighbors(const code_elem_t* code, size_t length, code_list_t& neighbors)
+{
+    enumerate_moves(code, length, neighbors, MOVES_COMPLETE, true, NULL, NULL);
+}
+
+// enumerate neighbors of every code in codes onto the end of neighbors,
+// where the neighbors of code i end up from firsts[i] up to firsts[i + 1]
+void enumerate_complete_neighbors(const code_list_t& codes, code_list_t& neighbors,
+                                  std::vector<size_t>& firsts)
 {
-    std::vector<code_t> list, t;
+    size_t count = code_list_size(codes);
+    firsts.resize(count + 1);
+    for (size_t i = 0; i < count; i++) {
+        firsts[i] = code_list_size(neighbors);
+        enumerate_complete_neighbors(code_list_elems(codes, i), code_list_length(codes, i), neighbors);
+    }
+    firsts[count] = code_list_size(neighbors);
+}
+
+// enumerate neighbors of code onto the end of neighbors, such that if
+// enumerated on X and Y, they'll be connected if they can be
+void enumerate_special_neighbors(const code_elem_t* code, size_t length, code_list_t& neighbors)
+{
+    enumerate_moves(code, length, neighbors, MOVES_SPECIAL, true, NULL, NULL);
+}
+
+// enumerates neighbors not enumerated by rest onto the end of neighbors
+void enumerate_nonspecial_neighbors(const code_elem_t* code, size_t length, code_list_t& neighbors)
+{
+    enumerate_moves(code, length, neighbors, MOVES_NONSPECIAL, true, NULL, NULL);
+}
 
-    // r1
-    list = r1_do_enumerate(code);
-    t = r1_undo_enumerate(code);
-    list.insert(list.end(), t.begin(), t.end());
+#ifndef FLAT_KNOTS
+static thread_local faces_t parent_faces;
 
-    // r2
-    t = r2_do_enumerate(code);
-    list.insert(list.end(), t.begin(), t.end());
-    t = r2_undo_enumerate(code);
-    list.insert(list.end(), t.begin(), t.end());
+// the same as the flat versions, but with the genus of each neighbor put
+// onto the end of genera
+void enumerate_complete_neighbors(const code_elem_t* code, size_t length, code_list_t& neighbors,
+                                  std::vector<int>& genera)
+{
+    load_faces(code, length, parent_faces);
+    enumerate_moves(code, length, neighbors, MOVES_COMPLETE, true, &parent_faces, &genera);
+}
 
-    // r3
-    t = r3_enumerate(code);
-    list.insert(list.end(), t.begin(), t.end());
+void enumerate_special_neighbors(const code_elem_t* code, size_t length, code_list_t& neighbors,
+                                 std::vector<int>& genera)
+{
+    load_faces(code, length, parent_faces);
+    enumerate_moves(code, length, neighbors, MOVES_SPECIAL, true, &parent_faces, &genera);
+}
 
-    return list;
+void enumerate_nonspecial_neighbors(const code_elem_t* code, size_t length, code_list_t& neighbors,
+                                    std::vector<int>& genera)
+{
+    load_faces(code, length, parent_faces);
+    enumerate_moves(code, length, neighbors, MOVES_NONSPECIAL, true, &parent_faces, &genera);
 }
 
-// enumerate neighbors of code
-std::vector<code_t> enumerate_complete_unsan_neighbors(const code_t& code)
+// enumerate the neighbors of code which are planar onto the end of
+// neighbors, only building the R2 moves which go along a face
+void enumerate_planar_neighbors(const code_elem_t* code, size_t length, code_list_t& neighbors)
 {
-    std::vector<code_t> list, t;
+    load_faces(code, length, parent_faces);
+    enumerate_moves(code, length, neighbors, MOVES_COMPLETE, true, &parent_faces, NULL, true);
+}
 
-    // r1
-    list = r1_do_unsan_enumerate(code);
-    t = r1_undo_unsan_enumerate(code);
-    list.insert(list.end(), t.begin(), t.end());
+std::vector<code_t> enumerate_planar_neighbors(const code_t& code)
+{
+    code_list_t list;
+    enumerate_planar_neighbors(code.data(), code.size(), list);
+    return code_list_codes(list);
+}
 
-    // r2
-    t = r2_do_unsan_enumerate(code);
-    list.insert(list.end(), t.begin(), t.end());
-    t = r2_undo_unsan_enumerate(code);
-    list.insert(list.end(), t.begin(), t.end());
+#ifdef TEST_GENUS
+// check the genus worked out for every neighbor against going around its
+// faces, on random codes of up to max_length chords
+bool test_neighbor_genus(size_t rounds, size_t max_length)
+{
+    code_list_t neighbors;
+    std::vector<int> genera;
+    for (size_t i = 0; i < rounds; i++) {
+        code_t code = random_code(rand() % max_length);
+
+        code_list_clear(neighbors); genera.clear();
+        enumerate_complete_neighbors(code.data(), code.size(), neighbors, genera);
+        for (size_t j = 0; j < code_list_size(neighbors); j++) {
+            int g = genus(code_list_elems(neighbors, j), code_list_length(neighbors, j));
+            if (genera[j] != g) {
+                std::cout << "Genus of neighbor " << stringify_code(code_list_get(neighbors, j)) << " of "
+                          << stringify_code(code) << " was " << genera[j] << " instead of " << g << std::endl;
+                return false;
+            }
+        }
 
-    // r3
-    t = r3_unsan_enumerate(code);
-    list.insert(list.end(), t.begin(), t.end());
+        // the planar neighbors have to be the ones of genus 0, in order
+        code_list_t planar, expected;
+        enumerate_planar_neighbors(code.data(), code.size(), planar);
+        for (size_t j = 0; j < code_list_size(neighbors); j++) {
+            if (!genera[j]) {
+                code_list_push(expected, code_list_elems(neighbors, j), code_list_length(neighbors, j));
+            }
+        }
 
-    return list;
+        if (planar.offsets != expected.offsets || planar.elems != expected.elems) {
+            std::cout << "Planar neighbors of " << stringify_code(code) << " don't match" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
 }
+#endif
+#endif
 
-// enumerate neighbors of code such that if enumerated on X and Y, they'll
-// be connected if they can be
-std::vector<code_t> enumerate_special_neighbors(const code_t& code)
+#ifdef TEST_MOVES
+// check the enumerators against the slow ways of doing the same, on random
+// codes of up to max_length chords
+bool test_moves(size_t rounds, size_t max_length)
 {
-    std::vector<code_t> list, t;
+    code_list_t fast, slow;
+    for (size_t i = 0; i < rounds; i++) {
+        code_t code = random_code(rand() % max_length);
+
+        code_list_clear(fast); code_list_clear(slow);
+        enumerate_moves(code.data(), code.size(), fast, MOVE_R2_DO, false, NULL, NULL);
+        r2_do_quadratic_list(code.data(), code.size(), slow);
+        if (fast.offsets != slow.offsets || fast.elems != slow.elems) {
+            std::cout << "R2 moves of " << stringify_code(code) << " don't match" << std::endl;
+            return false;
+        }
+
+        code_list_clear(fast); code_list_clear(slow);
+        enumerate_moves(code.data(), code.size(), fast, MOVE_R3, false, NULL, NULL);
+        r3_cubic_list(code.data(), code.size(), slow);
+        if (fast.offsets != slow.offsets || fast.elems != slow.elems) {
+            std::cout << "R3 moves of " << stringify_code(code) << " don't match" << std::endl;
+            return false;
+        }
+
+        // the undo moves have to make every diagram trying all of them
+        // does, each once
+        std::set<code_t> every;
+        code_elem_t id = next_id(code.data(), code.size());
+        size_t places = std::max(code.size(), (size_t) 1);
+        code_t moved(code.size() + 4), canonical;
+        for (size_t x = 0; x < places; x++) {
+            for (int j = 0; j < r1_undo_choices; j++) {
+                r1_undo(code.data(), code.size(), id, x, j & 1, (j >> 1) & 1, moved.data());
+                canonical.resize(code.size() + 2);
+                canonicalize_any_code(moved.data(), code.size() + 2, canonical.data());
+                every.insert(canonical);
+            }
 
-    // r1
-    list = r1_do_enumerate(code);
+            for (size_t y = x; y < places; y++) {
+                for (int j = 0; j < r2_undo_choices; j++) {
+#ifdef FLAT_KNOTS
+                    r2_undo(code.data(), code.size(), id, x, y, j & 1, false, (j >> 1) & 1, moved.data());
+#else
+                    r2_undo(code.data(), code.size(), id, x, y, j & 1, (j >> 1) & 1, (j >> 2) & 1, moved.data());
+#endif
+                    canonical.resize(code.size() + 4);
+                    canonicalize_any_code(moved.data(), code.size() + 4, canonical.data());
+                    every.insert(canonical);
+                }
+            }
+        }
 
-    // r2
-    t = r2_do_enumerate(code);
-    list.insert(list.end(), t.begin(), t.end());
+        code_list_clear(fast);
+        enumerate_nonspecial_neighbors(code.data(), code.size(), fast);
+        auto made = code_list_codes(fast);
+        auto r1 = r1_undo_enumerate(code), r2 = r2_undo_enumerate(code);
+        if (std::set<code_t>(made.begin(), made.end()) != every || r1.size() + r2.size() != every.size()) {
+            std::cout << "Undo moves of " << stringify_code(code) << " make " << r1.size() + r2.size()
+                      << " diagrams, not " << every.size() << std::endl;
+            return false;
+        }
 
-    // r3
-    t = r3_enumerate(code);
-    list.insert(list.end(), t.begin(), t.end());
+        // every move the iterator gives, built, has to be what the
+        // enumerators give, in the same order
+        auto neighbors = enumerate_complete_unsan_neighbors(code);
+        move_iter_t iter;
+        move_t move;
+        size_t count = 0;
+        move_iter_start(iter, code.data(), code.size());
+        while (move_iter_next(iter, move)) {
+            code_t moved(move_length(code.size(), move.type));
+            move_apply(code.data(), code.size(), move, moved.data());
+            if (count >= neighbors.size() || moved != neighbors[count]) {
+                std::cout << "Move " << count << " of " << stringify_code(code) << " doesn't match" << std::endl;
+                return false;
+            }
+            count++;
+        }
+
+        if (count != neighbors.size()) {
+            std::cout << "Moves of " << stringify_code(code) << " are missing" << std::endl;
+            return false;
+        }
 
-    return list;
+        // and any neighbor has to be found again from its move
+        auto sanitized = enumerate_complete_neighbors(code);
+        if (!sanitized.empty()) {
+            code_t& target = sanitized[rand() % sanitized.size()];
+            if (!find_move(code.data(), code.size(), target.data(), target.size(), move)) {
+                std::cout << "Move to " << stringify_code(target) << " not found" << std::endl;
+                return false;
+            }
+        }
+
+        // every symmetry commutes with the moves (and undoes itself), so
+        // a symmetric code's neighbors taken back through it are the
+        // code's own, and keeping one node for every symmetry of a code
+        // (SYMMETRY_REDUCED) finds the same neighbors as keeping them all
+        if (i % 10 == 0) {
+            std::set<code_t> unreduced(sanitized.begin(), sanitized.end()), reduced;
+            for (auto& neighbor: sanitized) {
+                reduced.insert(first_symmetric_code(neighbor));
+            }
+
+            for (int symmetry = 1; symmetry < SYMMETRIES; symmetry++) {
+                std::set<code_t> mapped, mapped_reduced;
+                for (auto& neighbor: enumerate_complete_neighbors(symmetric_code(code, symmetry))) {
+                    mapped.insert(symmetric_code(neighbor, symmetry));
+                    mapped_reduced.insert(first_symmetric_code(neighbor));
+                }
+
+                if (mapped != unreduced || mapped_reduced != reduced) {
+                    std::cout << "Neighbors of " << stringify_code(code) << " don't commute with symmetry "
+                              << symmetry << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+    // codes big enough to be handed out between threads have to give the
+    // same neighbors, in the same order, as going through them on one
+    int threads = omp_get_max_threads();
+    for (size_t i = 0; i < rounds / 100; i++) {
+        code_t code = random_code(enumerate_parallel_min / 2 + rand() % max_length);
+        code_list_t one, many;
+
+        omp_set_num_threads(1);
+        enumerate_complete_neighbors(code.data(), code.size(), one);
+        omp_set_num_threads(std::max(threads, 2));
+        enumerate_complete_neighbors(code.data(), code.size(), many);
+        omp_set_num_threads(threads);
+
+        if (one.offsets != many.offsets || one.elems != many.elems) {
+            std::cout << "Neighbors of " << stringify_code(code) << " change between threads" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
 }
+#endif
 
-// enumerates neighbors not enumerated by rest
-std::vector<code_t> enumerate_nonspecial_neighbors(const code_t& code)
+// enumerate neighbors of code
+std::vector<code_t> enumerate_complete_neighbors(const code_t& code)
 {
-    std::vector<code_t> list, t;
+    code_list_t list;
+    enumerate_complete_neighbors(code.data(), code.size(), list);
+    return code_list_codes(list);
+}
 
-    // r1
-    list = r1_undo_enumerate(code);
+// enumerate neighbors of code (unsan)
+std::vector<code_t> enumerate_complete_unsan_neighbors(const code_t& code)
+{
+    return enumerate_with(MOVES_COMPLETE, code, false);
+}
 
-    // r2
-    t = r2_undo_enumerate(code);
-    list.insert(list.end(), t.begin(), t.end());
+// enumerate neighbors of code such that if enumerated on X and Y, they'll
+// be connected if they can be
+std::vector<code_t> enumerate_special_neighbors(const code_t& code)
+{
+    code_list_t list;
+    enumerate_special_neighbors(code.data(), code.size(), list);
+    return code_list_codes(list);
+}
 
-    return list;
+// enumerates neighbors not enumerated by rest
+std::vector<code_t> enumerate_nonspecial_neighbors(const code_t& code)
+{
+    code_list_t list;
+    enumerate_nonspecial_neighbors(code.data(), code.size(), list);
+    return code_list_codes(list);
 }
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include "census.h"
+#include "gauss.h"
+#include <iostream>
+#include "rank.h"
+#include <random>
+#include <vector>
+
+// prefix depth to split a census over threads at
+static const size_t rank_prefix_depth = 4;
+
+// fill the table with every code with chords chords, from a census
+void rank_table_build(rank_table_t& table, size_t chords)
+{
+    table.chords = chords;
+    table.codes.clear();
+
+    // prefixes come out in order, and so do the codes under each one, so
+    // putting the parts back together in order keeps everything sorted
+    std::vector<code_t> prefixes = census_prefixes(chords, rank_prefix_depth);
+    std::vector<std::vector<packed_code_t>> parts(prefixes.size());
+
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t i = 0; i < prefixes.size(); i++) {
+        census_t census; census_start(census, chords, prefixes[i]);
+        code_t code;
+        while (census_next(census, code)) {
+            parts[i].push_back(pack_code(code));
+        }
+    }
+
+    size_t count = 0;
+    for (auto& iter: parts) {
+        count += iter.size();
+    }
+
+    table.codes.reserve(count);
+    for (auto& iter: parts) {
+        table.codes.insert(table.codes.end(), iter.begin(), iter.end());
+        std::vector<packed_code_t>().swap(iter);
+    }
+}
+
+size_t rank_table_size(const rank_table_t& table)
+{
+    return table.codes.size();
+}
+
+// the rank of a first ordered code, or RANK_NONE if it isn't in the table
+size_t rank_code(const rank_table_t& table, const packed_code_t& code)
+{
+    auto iter = std::lower_bound(table.codes.begin(), table.codes.end(), code);
+    if (iter == table.codes.end() || *iter != code) {
+        return RANK_NONE;
+    }
+
+    return iter - table.codes.begin();
+}
+
+// the code with a given rank
+packed_code_t unrank_code(const rank_table_t& table, size_t rank)
+{
+    return table.codes[rank];
+}
+
+#ifdef TEST_RANK
+// check that rank and unrank undo each other for every code in the table
+bool test_rank(const rank_table_t& table)
+{
+    std::mt19937_64 rng(table.chords);
+    for (size_t i = 0; i < rank_table_size(table); i++) {
+        packed_code_t code = unrank_code(table, i);
+        if (packed_length(code) != 2 * table.chords || first_ordered_code(code) != code) {
+            std::cout << "Code " << i << " isn't first ordered: ";
+            display_code(code);
+            return false;
+        }
+
+        if (rank_code(table, code) != i) {
+            std::cout << "Code " << i << " ranked as " << rank_code(table, code) << ": ";
+            display_code(code);
+            return false;
+        }
+    }
+
+    // and every first ordered code is in there, but nothing else
+    code_t raw(2 * table.chords), first(2 * table.chords);
+    for (size_t i = 0; i < 1000; i++) {
+        random_raw_code(table.chords, rng, raw.data());
+        canonicalize_code(raw.data(), raw.size(), first.data());
+        if (rank_code(table, pack_code(first)) == RANK_NONE) {
+            std::cout << "Didn't rank ";
+            display_code(first);
+            return false;
+        }
+
+        if (raw != first && rank_code(table, pack_code(raw)) != RANK_NONE) {
+            std::cout << "Ranked a code which isn't first ordered: ";
+            display_code(raw);
+            return false;
+        }
+    }
+
+    return true;
+}
+#endif
@@ -0,0 +1,116 @@
+#include "gauss.h"
+#include "genus.h"
+#include "hash.h"
+#include <omp.h>
+#include <random>
+#include "sample.h"
+#include <unordered_set>
+#include <vector>
+#include "virtual.h"
+
+// tries handed to each generator; every batch is seeded on its own, so the
+// samples don't depend on how batches land on threads
+static const size_t sample_batch = 1024;
+
+// sensible defaults: no filter, no dedupe
+sample_options_t sample_defaults(size_t count, size_t chords, uint64_t seed)
+{
+    sample_options_t options;
+    options.count = count;
+    options.chords = chords;
+    options.seed = seed;
+    options.dedupe = false;
+    options.filter = SAMPLE_ANY;
+#ifndef FLAT_KNOTS
+    options.genus = -1;
+#endif
+    options.max_tries = 0;
+
+    return options;
+}
+
+// if the code passes the filters in options
+static bool sample_wanted(const sample_options_t& options, const code_t& code)
+{
+    if (options.filter != SAMPLE_ANY &&
+        planar_knot(code) != (options.filter == SAMPLE_PLANAR)) {
+        return false;
+    }
+
+#ifndef FLAT_KNOTS
+    if (options.genus >= 0 && genus(code) != options.genus) {
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+// samples random canonical codes across threads, handing them to callback
+// (always from the calling thread, in the same order for the same options)
+// returns how many were handed out, which is less than asked only if it
+// gave up
+size_t sample_codes(const sample_options_t& options,
+                    const std::function<void(const code_t&)>& callback)
+{
+    size_t length = 2 * options.chords, found = 0, tries = 0;
+    // seed sequence for every batch
+    std::seed_seq seq{ (uint32_t) options.seed, (uint32_t) (options.seed >> 32) };
+    std::mt19937_64 seeder(seq);
+
+    std::unordered_set<code_t> seen;
+    std::vector<code_t> batch(sample_batch);
+    std::vector<char> wanted(sample_batch);
+    std::vector<uint64_t> seeds;
+
+    while (found < options.count && (!options.max_tries || tries < options.max_tries)) {
+        // enough batches to keep every thread busy
+        size_t batches = omp_get_max_threads();
+        seeds.resize(batches);
+        for (auto& iter: seeds) {
+            iter = seeder();
+        }
+        batch.resize(batches * sample_batch);
+        wanted.resize(batches * sample_batch);
+
+        #pragma omp parallel for schedule(static, 1)
+        for (size_t b = 0; b < batches; b++) {
+            std::mt19937_64 rng(seeds[b]);
+            std::vector<code_elem_t> raw(length);
+            for (size_t i = b * sample_batch; i < (b + 1) * sample_batch; i++) {
+                random_raw_code(options.chords, rng, raw.data());
+                batch[i].resize(length);
+                canonicalize_code(raw.data(), length, batch[i].data());
+                wanted[i] = sample_wanted(options, batch[i]);
+            }
+        }
+
+        for (size_t i = 0; i < batch.size() && found < options.count; i++) {
+            if (options.max_tries && tries >= options.max_tries) {
+                break;
+            }
+            tries++;
+
+            if (!wanted[i]) {
+                continue;
+            }
+
+            if (options.dedupe && !seen.insert(batch[i]).second) {
+                continue;
+            }
+
+            callback(batch[i]);
+            found++;
+        }
+    }
+
+    return found;
+}
+
+// the same, writing them out a line each
+size_t sample_codes(const sample_options_t& options, std::ostream& out)
+{
+    return sample_codes(options, [&out](const code_t& code) {
+        out << stringify_code(code) << '\n';
+    });
+}
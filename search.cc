@@ -1,9 +1,14 @@
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include "gauss.h"
 #include "genus.h"
 #include "graph.h"
+#include "hash.h"
+#include "invariant.h"
 #include <iostream>
 #include <limits>
+#include "memo.h"
 #include "moves.h"
 #include <string>
 #include "subdiag.h"
@@ -12,22 +17,6 @@
 #include <utility>
 #include "virtual.h"
 
-namespace std {
-    template <>
-    struct hash<code_t> {
-        size_t operator()(const code_t& k) const
-        {
-            // return std::hash<std::string>()(stringify_code(k));
-            // stolen from http://stackoverflow.com/questions/20511347/a-good-hash-function-for-a-vector
-            code_elem_t seed = k.size();
-            for (auto i: k) {
-                seed ^= i + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-            }
-            return seed;
-        }
-    };
-}
-
 #ifdef TEST_BRUTE
 static const size_t max_indices = 6000;
 static size_t cur_index = 0, not_added = 0;
@@ -39,7 +28,7 @@ static size_t classical_dist[max_indices][max_indices], virtual_dist[max_indices
 static void brute_insert_node(node_t* node);
 #endif
 
-static std::unordered_map<code_t, node_t*> graph_nodes;
+static std::unordered_map<packed_code_t, node_t*> graph_nodes;
 static std::unordered_set<node_t*> prune_dirty;
 
 #ifdef TEST_MENU
@@ -60,29 +49,72 @@ static node_t* alloc_node()
     return &chunk[chunk_idx++];
 }
 
-static node_t* get_node(const code_t& code)
+// make a node for code, which isn't in the graph yet, at slot
+// genus is the code's genus if it's already known, or negative
+static node_t* new_node(const packed_code_t& code, node_t*& slot, int genus = -1)
 {
-    node_t *node;
-    auto iter = graph_nodes.find(code);
-    if (iter == graph_nodes.end()) {
-        // not found, so we need to create the node
-        node = alloc_node();
-        node->code = code;
-        node->pruneify = false;
-        node->neighbors_explored = node->sneighbors_explored = false;
+    node_t* node = alloc_node();
+    node->code = code;
+    node->pruneify = false;
+    node->neighbors_explored = node->sneighbors_explored = false;
+#ifndef FLAT_KNOTS
+    node->planar_neighbors_explored = false;
+#endif
 #ifdef TEST_BRUTE
-        node->index = max_indices;
+    node->index = max_indices;
+    node->invariants_known = false;
 #endif
-        node->planar = planar_knot(code);
 
-        graph_nodes[code] = node;
-    } else {
-        node = iter->second;
-    }
+    node->planar = (genus >= 0) ? (genus == 0) : planar_knot(unpack_code(code));
 
+    slot = node;
     return node;
 }
 
+// genus is the code's genus if it's already known, or negative
+static node_t* get_node(const packed_code_t& input_code, int genus = -1)
+{
+#ifdef SYMMETRY_REDUCED
+    // every move commutes with the symmetries, so a representative's
+    // neighbors are representatives' neighbors too
+    packed_code_t code = first_symmetric_code(input_code);
+#else
+    const packed_code_t& code = input_code;
+#endif
+
+    // look for it and make room for it at once
+    auto iter = graph_nodes.emplace(code, nullptr);
+    if (iter.second) {
+        // not found, so we need to create the node
+        return new_node(code, iter.first->second, genus);
+    }
+
+    return iter.first->second;
+}
+
+// how many codes were too big to be nodes
+static size_t too_big = 0;
+
+// the node for a renumbered and ordered code, or NULL if it has too many
+// chords to be packed into a node's key (which is only said the first time)
+static node_t* get_node(const code_elem_t* code, size_t length, int genus = -1)
+{
+    if (!packed_fits(length)) {
+        if (!too_big++) {
+            std::cerr << "Leaving out codes of more than " << PACKED_MAX_CHORDS
+                      << " chords, which are too big to be nodes" << std::endl;
+        }
+        return NULL;
+    }
+
+    return get_node(pack_code(code, length), genus);
+}
+
+static node_t* get_node(const code_t& code)
+{
+    return get_node(code.data(), code.size());
+}
+
 static bool is_planar(const node_t* node)
 {
     return node->planar;
@@ -93,10 +125,25 @@ static bool is_planar(const code_t& code)
     return get_node(code)->planar;
 }
 
-static void add_neighbors(node_t *node, std::vector<code_t>& neighbors)
+// neighbors are enumerated in here, reused across nodes
+static code_list_t neighbor_list;
+#ifndef FLAT_KNOTS
+// along with the genus of each, so it doesn't need working out again
+static std::vector<int> neighbor_genera;
+#endif
+
+static void add_neighbors(node_t *node, const code_list_t& neighbors)
 {
-    for (auto& iter: neighbors) {
-        node_t *neigh = get_node(iter);
+    for (size_t i = 0; i < code_list_size(neighbors); i++) {
+#ifndef FLAT_KNOTS
+        node_t *neigh = get_node(code_list_elems(neighbors, i), code_list_length(neighbors, i),
+                                 neighbor_genera[i]);
+#else
+        node_t *neigh = get_node(code_list_elems(neighbors, i), code_list_length(neighbors, i));
+#endif
+        if (!neigh) {
+            continue;
+        }
         node->neighbors.insert(neigh);
         neigh->neighbors.insert(node);
     }
@@ -109,8 +156,15 @@ static void explore_special_neighbors(node_t* node)
         return;
     }
 
-    auto neighbors = enumerate_special_neighbors(node->code);
-    add_neighbors(node, neighbors);
+    code_t code = unpack_code(node->code);
+    code_list_clear(neighbor_list);
+#ifndef FLAT_KNOTS
+    neighbor_genera.clear();
+    enumerate_special_neighbors(code.data(), code.size(), neighbor_list, neighbor_genera);
+#else
+    enumerate_special_neighbors(code.data(), code.size(), neighbor_list);
+#endif
+    add_neighbors(node, neighbor_list);
 
     node->sneighbors_explored = true;
 }
@@ -122,25 +176,72 @@ static void explore_complete_neighbors(node_t* node)
         return;
     }
 
-    std::vector<code_t> neighbors;
+    code_t code = unpack_code(node->code);
+    code_list_clear(neighbor_list);
+#ifndef FLAT_KNOTS
+    neighbor_genera.clear();
     if (node->sneighbors_explored) {
-        neighbors = enumerate_nonspecial_neighbors(node->code);
+        enumerate_nonspecial_neighbors(code.data(), code.size(), neighbor_list, neighbor_genera);
     } else {
-        neighbors = enumerate_complete_neighbors(node->code);
+        enumerate_complete_neighbors(code.data(), code.size(), neighbor_list, neighbor_genera);
     }
+#else
+    if (node->sneighbors_explored) {
+        enumerate_nonspecial_neighbors(code.data(), code.size(), neighbor_list);
+    } else {
+        enumerate_complete_neighbors(code.data(), code.size(), neighbor_list);
+    }
+#endif
 
-    add_neighbors(node, neighbors);
+    add_neighbors(node, neighbor_list);
     node->neighbors_explored = node->sneighbors_explored = true;
 }
 
+#ifndef FLAT_KNOTS
+// the planar neighbors of a planar node, only building those rather than
+// exploring all of them (unless that's already been done)
+static const std::vector<node_t*>& planar_neighbors(node_t* node)
+{
+    std::vector<node_t*>& planar = node->planar_neighbors;
+    if (node->planar_neighbors_explored) {
+        return planar;
+    }
+
+    if (node->neighbors_explored) {
+        for (auto neigh: node->neighbors) {
+            if (is_planar(neigh)) {
+                planar.push_back(neigh);
+            }
+        }
+    } else {
+        code_t code = unpack_code(node->code);
+        code_list_clear(neighbor_list);
+        enumerate_planar_neighbors(code.data(), code.size(), neighbor_list);
+
+        for (size_t i = 0; i < code_list_size(neighbor_list); i++) {
+            node_t *neigh = get_node(code_list_elems(neighbor_list, i), code_list_length(neighbor_list, i), 0);
+            if (!neigh) {
+                continue;
+            }
+            node->neighbors.insert(neigh);
+            neigh->neighbors.insert(node);
+            planar.push_back(neigh);
+        }
+    }
+
+    node->planar_neighbors_explored = true;
+    return planar;
+}
+#endif
+
 static void generate_subs(node_t* node)
 {
     if (!node->subs.empty()) {
         return;
     }
 
-    // generate all classical subdiagrams
-    auto subdiags = subdiagrams(node->code);
+    // generate all classical subdiagrams, out of the ones which could be
+    auto subdiags = even_subdiagrams(unpack_code(node->code));
     for (auto iter: subdiags) {
         node_t *sub = get_node(iter);
         if (is_planar(sub)) {
@@ -152,7 +253,7 @@ static void generate_subs(node_t* node)
 
 static void add_r3_neighborhood_subs(node_t* node, std::set<node_t*>& seen, node_t* cur)
 {
-    auto cur_r3_neighbors = r3_enumerate(cur->code);
+    auto cur_r3_neighbors = r3_enumerate(unpack_code(cur->code));
     for (auto iter: cur_r3_neighbors) {
         auto n = get_node(iter); generate_subs(n);
         // if we've seen this one, don't explore it again
@@ -203,6 +304,7 @@ static node_t* s_ify(node_t* node)
             // need to add every neighbor's s or nodes one distance away
             node->s.insert(n->s.begin(), n->s.end());
             for (auto s_elem: n->s) {
+#ifdef FLAT_KNOTS
                 explore_complete_neighbors(s_elem);
                 for (auto s_elem_neighbor: s_elem->neighbors) {
                     if (is_planar(s_elem_neighbor)) {
@@ -210,6 +312,14 @@ static node_t* s_ify(node_t* node)
                         node->s.insert(s_elem_neighbor);
                     }
                 }
+#else
+                // everything in s is planar, so only its planar neighbors
+                // need building
+                for (auto s_elem_neighbor: planar_neighbors(s_elem)) {
+                    explore_special_neighbors(s_elem_neighbor);
+                    node->s.insert(s_elem_neighbor);
+                }
+#endif
             }
 
             break;
@@ -241,7 +351,7 @@ static node_t* s_ify(node_t* node)
 static node_t* s_ify(const code_t& code)
 {
     node_t* node = get_node(code);
-    return s_ify(node);
+    return node ? s_ify(node) : NULL;
 }
 
 // make a node that's going to be pruned
@@ -273,7 +383,7 @@ static node_t* prune_ify(node_t* node)
 static node_t* prune_ify(const code_t& code)
 {
     node_t* node = get_node(code);
-    return prune_ify(node);
+    return node ? prune_ify(node) : NULL;
 }
 
 // check if e is a plausible erasure for d
@@ -418,6 +528,17 @@ static void test_menu()
 #endif
 
 #ifdef TEST_BRUTE
+static const invariants_t& node_invariants(node_t* node)
+{
+    if (!node->invariants_known) {
+        code_t code = unpack_code(node->code);
+        node->invariants = code_invariants(code);
+        node->invariants_known = true;
+    }
+
+    return node->invariants;
+}
+
 void brute_insert_node(node_t* node)
 {
     if (cur_index < max_indices && node->index == max_indices) {
@@ -428,30 +549,17 @@ void brute_insert_node(node_t* node)
     }
 }
 
-void test_brute()
+// work out the distances between members, which no moves from outside
+// them get to, and report on them
+static void brute_class(const std::vector<size_t>& members, size_t& max_classic, size_t& max_virt)
 {
-    for (size_t i = 0; i < cur_index; i++) {
-        for (size_t j = i + 1; j < cur_index; j++) {
-            // a bit hacky, but alright
-            virtual_dist[i][j] = classical_dist[i][j] = 
-                virtual_dist[j][i] = classical_dist[j][i] = std::numeric_limits<size_t>::max() / 2;
-        }
-    }
-
-    for (size_t i = 0; i < cur_index; i++) {
-        for (auto iter: node_table[i]->neighbors) {
-            if (iter->index < max_indices) {
-                virtual_dist[i][iter->index] = virtual_dist[iter->index][i] = 1;
-                if (is_planar(node_table[i]) && is_planar(iter)) {
-                    classical_dist[i][iter->index] = classical_dist[iter->index][i] = 1;
+    for (size_t k: members) {
+        for (size_t i: members) {
+            for (size_t j: members) {
+                if (j > i) {
+                    break;
                 }
-            }
-        }
-    }
 
-    for (size_t k = 0; k < cur_index; k++) {
-        for (size_t i = 0; i < cur_index; i++) {
-            for (size_t j = 0; j <= i; j++) {
                 if (virtual_dist[i][j] > virtual_dist[i][k] + virtual_dist[k][j]) {
                     virtual_dist[i][j] = virtual_dist[j][i] =
                                         virtual_dist[i][k] + virtual_dist[k][j];
@@ -467,9 +575,12 @@ void test_brute()
         }
     }
 
-    size_t max_classic = 0, max_virt = 0;
-    for (size_t i = 0; i < cur_index; i++) {
-        for (size_t j = i + 1; j < cur_index; j++) {
+    for (size_t i: members) {
+        for (size_t j: members) {
+            if (j <= i) {
+                continue;
+            }
+
             if (classical_dist[i][j] != std::numeric_limits<size_t>::max() / 2)
                 max_classic = std::max(max_classic, classical_dist[i][j]);
             if (virtual_dist[i][j] != std::numeric_limits<size_t>::max() / 2)
@@ -485,13 +596,53 @@ void test_brute()
             }
         }
     }
+}
 
+void test_brute()
+{
+    for (size_t i = 0; i < cur_index; i++) {
+        for (size_t j = i + 1; j < cur_index; j++) {
+            // a bit hacky, but alright
+            virtual_dist[i][j] = classical_dist[i][j] = 
+                virtual_dist[j][i] = classical_dist[j][i] = std::numeric_limits<size_t>::max() / 2;
+        }
+    }
+
+    for (size_t i = 0; i < cur_index; i++) {
+        for (auto iter: node_table[i]->neighbors) {
+            if (iter->index < max_indices) {
+                virtual_dist[i][iter->index] = virtual_dist[iter->index][i] = 1;
+                if (is_planar(node_table[i]) && is_planar(iter)) {
+                    classical_dist[i][iter->index] = classical_dist[iter->index][i] = 1;
+                }
+            }
+        }
+    }
+
+    // no moves change the index polynomial, so nodes with different ones
+    // are never joined, and the distances only need working out between
+    // nodes with the same one
+    std::unordered_map<uint64_t, std::vector<size_t>> classes;
+    for (size_t i = 0; i < cur_index; i++) {
+        classes[node_invariants(node_table[i]).index].push_back(i);
+    }
+
+    size_t max_classic = 0, max_virt = 0, apart = cur_index * (cur_index - 1) / 2;
+    for (auto& entry: classes) {
+        size_t size = entry.second.size();
+        apart -= size * (size - 1) / 2;
+        brute_class(entry.second, max_classic, max_virt);
+    }
+
+    std::cout << "Pairs apart by invariants " << apart << std::endl;
     std::cout << "Max classical " << max_classic << std::endl;
     std::cout << "Max virtual " << max_virt << std::endl;
 }
 
-static bool find_node(const code_t& origin, const code_t& dest, size_t depth, 
-                        std::unordered_set<code_t>& visited)
+// dest_invariants are the invariants of dest, which is only looked for
+// through planar diagrams that could still get to it in the moves left
+static bool find_node(const code_t& origin, const code_t& dest, size_t depth,
+                        std::unordered_set<code_t>& visited, const invariants_t& dest_invariants)
 {
     if (!depth) {
         if (origin == dest) {
@@ -501,8 +652,31 @@ static bool find_node(const code_t& origin, const code_t& dest, size_t depth,
         }
     }
 
-    auto list = enumerate_complete_neighbors(origin);
-    for (auto iter: list) {
+    if (depth == 1) {
+        // only dest itself is any use, so only build neighbors that could be
+        move_t move;
+        return find_move(origin.data(), origin.size(), dest.data(), dest.size(), move);
+    }
+
+    // neighbors are built one at a time, so finding dest stops the rest
+    // being built at all
+    move_iter_t moves;
+    move_t move;
+    move_iter_start(moves, origin.data(), origin.size());
+    while (move_iter_next(moves, move)) {
+        code_t iter(move_length(origin.size(), move.type));
+        move_neighbor(origin.data(), origin.size(), move, iter.data());
+        if (iter == dest) {
+            return true;
+        }
+
+        // not marked visited, since it might be close enough with more
+        // moves left
+        invariants_t invariants = code_invariants(iter);
+        if (invariants_apart(invariants, dest_invariants, depth - 1)) {
+            continue;
+        }
+
         auto find = visited.find(iter);
         if (find != visited.end()) { 
             continue;
@@ -510,11 +684,13 @@ static bool find_node(const code_t& origin, const code_t& dest, size_t depth,
             visited.insert(iter);
         }
 
-        if (iter == dest) { 
-            return true;
-        } else if (!planar_knot(iter)) {
+#ifndef FLAT_KNOTS
+        if (invariants.genus != 0) {
+#else
+        if (!planar_knot(iter)) {
+#endif
             continue;
-        } if (find_node(iter, dest, depth - 1, visited)) {
+        } if (find_node(iter, dest, depth - 1, visited, dest_invariants)) {
             return true;
         }
     }
@@ -522,6 +698,61 @@ static bool find_node(const code_t& origin, const code_t& dest, size_t depth,
     return false;
 }
 
+static bool find_node(const code_t& origin, const code_t& dest, size_t depth, 
+                        std::unordered_set<code_t>& visited)
+{
+    invariants_t dest_invariants = code_invariants(dest);
+    if (invariants_apart(code_invariants(origin), dest_invariants, depth)) {
+        return false;
+    }
+
+    return find_node(origin, dest, depth, visited, dest_invariants);
+}
+
+#endif
+
+#ifdef TEST_HASH_STATS
+// report how well graph_nodes is spread over its buckets, and whether any
+// codes share a full 64-bit hash
+static void hash_stats()
+{
+    size_t buckets = graph_nodes.bucket_count(), used = 0, max_load = 0, collided = 0;
+    for (size_t i = 0; i < buckets; i++) {
+        size_t load = graph_nodes.bucket_size(i);
+        if (load) {
+            used++;
+            collided += load - 1;
+        }
+        max_load = std::max(max_load, load);
+    }
+
+    std::vector<size_t> hashes;
+    for (auto& iter: graph_nodes) {
+        hashes.push_back(std::hash<packed_code_t>()(iter.first));
+    }
+    std::sort(hashes.begin(), hashes.end());
+    size_t full_collisions = hashes.size() - (std::unique(hashes.begin(), hashes.end()) - hashes.begin());
+
+    // with a uniform hash, n keys in m buckets leave about
+    // m * (1 - (1 - 1/m)^n) buckets used
+    size_t nodes = graph_nodes.size();
+    double expected_used = buckets * (1 - std::pow(1 - 1.0 / buckets, (double) nodes));
+
+    std::cout << "Hash stats for " << nodes << " nodes in " << buckets << " buckets" << std::endl;
+    std::cout << "Load factor " << graph_nodes.load_factor() << ", max bucket " << max_load << std::endl;
+    std::cout << "Buckets used " << used << " (uniform expects " << (size_t) expected_used << ")" << std::endl;
+    std::cout << "Bucket collisions " << collided << " (uniform expects "
+              << (size_t) (nodes - expected_used) << ")" << std::endl;
+    std::cout << "Full 64-bit collisions " << full_collisions << std::endl;
+
+    memo_stats_t memo = memo_stats();
+    std::cout << "Memo hits " << memo.hits << ", misses " << memo.misses << ", "
+              << memo.used << " of " << memo.slots << " slots used" << std::endl;
+
+    move_stats_t moves = move_stats();
+    std::cout << "Undo moves " << moves.candidates << ", " << moves.avoided << " never built as the same as "
+              << "another, " << moves.dropped << " dropped once built" << std::endl;
+}
 #endif
 
 void explore()
@@ -602,4 +833,8 @@ void explore()
     std::cout << "Beginning hillary test" << std::endl;
     test_hillary();
     std::cout << "Finished hillary test" << std::endl;
+
+#ifdef TEST_HASH_STATS
+    hash_stats();
+#endif
 }
@@ -1,26 +1,12 @@
 #include <cassert>
 #include "gauss.h"
 #include "graph.h"
+#include "hash.h"
+#include "interlace.h"
 #include "subdiag.h"
 #include <unordered_set>
 #include <vector>
 
-namespace std {
-    template <>
-    struct hash<code_t> {
-        size_t operator()(const code_t &k) const
-        {
-            // return std::hash<std::string>()(stringify_code(k));
-            // stolen from http://stackoverflow.com/questions/20511347/a-good-hash-function-for-a-vector
-            code_elem_t seed = k.size();
-            for (auto i: k) {
-                seed ^= i + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-            }
-            return seed;
-        }
-    };
-}
-
 std::vector< std::unordered_set<code_elem_t> > subsets[MAX_CHORDS + 1];
 
 // initialize the a list of subsets
@@ -62,37 +48,73 @@ void subsets_init()
 // }
 
 // remove chords from the code based on set
-static code_t remove_chords(const code_t &code, const std::unordered_set<code_elem_t> &set)
+static packed_code_t remove_chords(const code_t &code, const std::unordered_set<code_elem_t> &set)
 {
-    code_t removed;
+    code_elem_t removed[2 * MAX_CHORDS], renum[MAX_CHORDS];
+    size_t length = 0;
+    for (size_t i = 0; i < MAX_CHORDS; i++) renum[i] = -1;
+
+    code_elem_t cur_max = 0;
     for (auto& iter: code) {
-        if (set.find(ELEM_ID(iter)) != set.end()) {
-            removed.push_back(iter);
+        code_elem_t id = ELEM_ID(iter);
+        if (set.find(id) != set.end()) {
+            if (renum[id] == -1) {
+                renum[id] = cur_max++;
+            }
+            removed[length++] = (renum[id] << ELEM_ID_SHIFT) | (iter & ELEM_FLAGS_MASK);
         }
     }
 
-    renumber_code(removed, code.size() / 2);
-    return removed;
+    return pack_code(removed, length);
 }
 
-// get subdiagrams of a code
-std::unordered_set<code_t> subdiagrams(const code_t& code)
+// get subdiagrams of a code, only the ones which could be planar if even
+// is set
+static std::unordered_set<packed_code_t> subdiagrams(const code_t& code, bool even)
 {
-    std::unordered_set<code_t> result;
+    std::unordered_set<packed_code_t> result;
 
     assert(code.size() / 2 <= MAX_CHORDS);
 
+    interlace_t interlace;
+    if (even) {
+        interlace_build(interlace, code.data(), code.size());
+    }
+
     auto &lists = subsets[code.size() / 2];
     // each subset is associated with a list of what chords to remove
     for (auto& iter: lists) {
+        if (even) {
+            uint64_t set = 0;
+            for (auto id: iter) {
+                set |= 1ull << id;
+            }
+
+            if (!interlace_even(interlace, &set)) {
+                continue;
+            }
+        }
+
         result.insert(remove_chords(code, iter));
     }
 
     // order them after removing duplicates one
-    std::unordered_set<code_t> result_ordered;
+    std::unordered_set<packed_code_t> result_ordered;
     for (auto& iter: result) {
         result_ordered.insert(first_ordered_code(iter));
     }
 
     return result_ordered;
 }
+
+// get subdiagrams of a code
+std::unordered_set<packed_code_t> subdiagrams(const code_t& code)
+{
+    return subdiagrams(code, false);
+}
+
+// get subdiagrams of a code which could be planar
+std::unordered_set<packed_code_t> even_subdiagrams(const code_t& code)
+{
+    return subdiagrams(code, true);
+}
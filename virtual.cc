@@ -5,13 +5,109 @@
 #include "gauss.h"
 #include "genus.h"
 #include <iostream>
+#include "memo.h"
 #include <set>
 #include <tuple>
 #include <utility>
+#include <vector>
+#include "virtual.h"
+
+// if the element is +i rather than -i below: its sign, flipped for U for
+// classical knots
+static inline bool positive_symbol(code_elem_t elem)
+{
+#ifndef FLAT_KNOTS
+    return (SIGN(elem) > 0) == !!(elem & ELEM_OU_MASK);
+#else
+    return SIGN(elem) > 0;
+#endif
+}
 
 // takes in a gauss code and returns true if it's planar/classical
-// the cubic version
-bool planar_knot_cubic(const code_t& input_code)
+// the cubic version, with S_i (see below) kept as bit vectors by chord of
+// its positive and negative symbols, so each test is an AND and a popcount
+// and it's n^3 / 64
+bool planar_knot_cubic(const code_elem_t* code, size_t length)
+{
+    static const size_t none = -1;
+    static thread_local std::vector<size_t> plus;
+    static thread_local std::vector<uint64_t> pos, neg;
+
+    size_t chords = 0;
+    for (size_t i = 0; i < length; i++) {
+        chords = std::max(chords, (size_t) ELEM_ID(code[i]) + 1);
+    }
+
+    size_t words = (chords + 63) / 64;
+    plus.assign(chords, none);
+    pos.assign(chords * words, 0); neg.assign(chords * words, 0);
+
+    for (size_t i = 0; i < length; i++) {
+        if (positive_symbol(code[i])) {
+            plus[ELEM_ID(code[i])] = i;
+        }
+    }
+
+    // construct S_i, the symbols between +i and -i in the cyclic
+    // gauss code
+    for (size_t i = 0; i < chords; i++) {
+        if (plus[i] == none) {
+            continue;
+        }
+
+        uint64_t *pos_i = &pos[i * words], *neg_i = &neg[i * words];
+        for (size_t idx = (plus[i] + 1) % length; ELEM_ID(code[idx]) != i; idx = (idx + 1) % length) {
+            size_t k = ELEM_ID(code[idx]);
+            uint64_t* bits = positive_symbol(code[idx]) ? pos_i : neg_i;
+            bits[k / 64] |= 1ull << (k % 64);
+        }
+    }
+
+    // the sum of signs in S_i must be 0
+    for (size_t i = 0; i < chords; i++) {
+        int sum = 0;
+        for (size_t w = 0; w < words; w++) {
+            sum += __builtin_popcountll(pos[i * words + w]) - __builtin_popcountll(neg[i * words + w]);
+        }
+
+        if (sum) {
+            return false;
+        }
+    }
+
+    // the sum of signs in (S_i \cup {+i, -i}) \cap (S_j^{-1})
+    // must be zero, where S_j^{-1} has all superscripts reversed: so the
+    // positive symbols of S_i \cup {+i} against the negative ones of S_j,
+    // less the negative symbols of S_i \cup {-i} against the positive ones
+    for (size_t i = 0; i < chords; i++) {
+        const uint64_t *pos_i = &pos[i * words], *neg_i = &neg[i * words];
+        for (size_t j = 0; j < chords; j++) {
+            const uint64_t *pos_j = &pos[j * words], *neg_j = &neg[j * words];
+
+            int sum = 0;
+            for (size_t w = 0; w < words; w++) {
+                uint64_t self = (w == i / 64) ? (1ull << (i % 64)) : 0;
+                sum += __builtin_popcountll((pos_i[w] | self) & neg_j[w]) -
+                       __builtin_popcountll((neg_i[w] | self) & pos_j[w]);
+            }
+
+            if (sum) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool planar_knot_cubic(const code_t& code)
+{
+    return planar_knot_cubic(code.data(), code.size());
+}
+
+#ifdef TEST_PLANAR
+// the cubic version with sets, which the bitset one is checked against
+static bool planar_knot_sets(const code_t& input_code)
 {
     // complexity is: n^3, but there are other bottlenecks
     // from https://arxiv.org/pdf/math/0610929.pdf (which has a typo for S_j^{-1})
@@ -93,13 +189,119 @@ bool planar_knot_cubic(const code_t& input_code)
 
     return true;
 }
+#endif
 
 // takes in a gauss code and returns true if it's planar/classical
+bool planar_knot(const code_elem_t* code, size_t length)
+{
+#ifndef FLAT_KNOTS
+    return (genus(code, length) == 0);
+#else
+    // the cubic version is costly, so remember it in the cache
+    packed_code_t key; int value;
+    bool keyed = memo_key(code, length, key);
+    if (keyed && memo_find(key, value)) {
+        return value;
+    }
+
+    value = planar_knot_cubic(code, length);
+    if (keyed) {
+        memo_insert(key, value);
+    }
+
+    return value;
+#endif
+}
+
 bool planar_knot(const code_t& code)
 {
+    return planar_knot(code.data(), code.size());
+}
+
+// set bit i of planar (a word for every 64 codes) if code i of the count
+// codes of length elements, stored back to back, is planar
+void planar_knots(const code_elem_t* codes, size_t count, size_t length, uint64_t* planar)
+{
+    std::fill(planar, planar + (count + 63) / 64, 0);
+
 #ifndef FLAT_KNOTS
-    return (genus(code) == 0);
+    static thread_local std::vector<int> genera;
+    genera.resize(count);
+    code_genera(codes, count, length, genera.data());
+
+    for (size_t i = 0; i < count; i++) {
+        planar[i / 64] |= (uint64_t) (genera[i] == 0) << (i % 64);
+    }
 #else
-    return planar_knot_cubic(code);
+    for (size_t i = 0; i < count; i++) {
+        planar[i / 64] |= (uint64_t) planar_knot_cubic(codes + i * length, length) << (i % 64);
+    }
 #endif
 }
+
+// the same for every code in a list, a run of codes of the same length at
+// a time
+void planar_knots(const code_list_t& codes, std::vector<uint64_t>& planar)
+{
+    static thread_local std::vector<uint64_t> run_planar;
+
+    size_t count = code_list_size(codes);
+    planar.assign((count + 63) / 64, 0);
+
+    size_t first = 0;
+    while (first < count) {
+        size_t length = code_list_length(codes, first), last = first + 1;
+        while (last < count && code_list_length(codes, last) == length) {
+            last++;
+        }
+
+        run_planar.resize((last - first + 63) / 64);
+        planar_knots(code_list_elems(codes, first), last - first, length, run_planar.data());
+        for (size_t i = first; i < last; i++) {
+            size_t j = i - first;
+            planar[i / 64] |= ((run_planar[j / 64] >> (j % 64)) & 1) << (i % 64);
+        }
+
+        first = last;
+    }
+}
+
+#ifdef TEST_PLANAR
+// check planar_knot_cubic against the version with sets, on random codes of
+// up to max_length chords
+bool test_planar(size_t rounds, size_t max_length)
+{
+    for (size_t i = 0; i < rounds; i++) {
+        code_t code = random_code(rand() % max_length + 1);
+        if (planar_knot_cubic(code) != planar_knot_sets(code)) {
+            std::cout << "Mismatch on " << stringify_code(code) << ": " << planar_knot_cubic(code)
+                      << " vs " << planar_knot_sets(code) << std::endl;
+            return false;
+        }
+    }
+
+    // and planar_knots against planar_knot, on batches of random codes of
+    // the same length
+    for (size_t i = 0; i < rounds / 100; i++) {
+        size_t chords = rand() % max_length + 1, count = rand() % 100;
+
+        code_list_t codes;
+        for (size_t j = 0; j < count; j++) {
+            code_t code = random_code(chords);
+            code_list_push(codes, code.data(), code.size());
+        }
+
+        std::vector<uint64_t> planar;
+        planar_knots(codes, planar);
+        for (size_t j = 0; j < count; j++) {
+            code_t code = code_list_get(codes, j);
+            if (planar_knot(code) != (bool) ((planar[j / 64] >> (j % 64)) & 1)) {
+                std::cout << "Batch mismatch on " << stringify_code(code) << std::endl;
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+#endif